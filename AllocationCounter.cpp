@@ -0,0 +1,97 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+void AllocationCounter::start() {
+    allocations.store(0, std::memory_order_relaxed);
+    allocatedBytes.store(0, std::memory_order_relaxed);
+    counting.store(true, std::memory_order_release);
+}
+
+void AllocationCounter::stop() {
+    counting.store(false, std::memory_order_release);
+}
+
+uint64_t AllocationCounter::getAllocations() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::getBytes() {
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+static void* countedAllocate(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0) size = 1;
+    
+    // Same contract as the standard operator new: retry through the
+    // new-handler until it gives up
+    while (true) {
+        void* pointer = std::malloc(size);
+        if (pointer) return pointer;
+        
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) return nullptr;
+        handler();
+    }
+}
+
+void* operator new(std::size_t size) {
+    void* pointer = countedAllocate(size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](std::size_t size) {
+    void* pointer = countedAllocate(size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
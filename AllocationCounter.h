@@ -0,0 +1,27 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+/**
+ * Test hook that counts heap allocations made through global operator new
+ * (so every standard container) while counting is switched on. Linking
+ * AllocationCounter.cpp replaces the global allocation functions; they
+ * forward to malloc/free and cost one relaxed atomic load when counting
+ * is off. Only the benchmark links it, and hands it to
+ * WaterfallPiano::runBenchmark() as an AllocationProbe.
+ *
+ * Memory that C libraries (SDL, ALSA, the GPU driver) take with malloc
+ * directly is not seen.
+ */
+class AllocationCounter {
+public:
+    // Zero the counters and start counting on every thread
+    static void start();
+    static void stop();
+    
+    static uint64_t getAllocations();
+    static uint64_t getBytes();
+};
+
+#endif // ALLOCATION_COUNTER_H
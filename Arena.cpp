@@ -0,0 +1,75 @@
+#include "Arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t blockSize)
+    : current(0)
+    , offset(0)
+    , used(0)
+    , blockSize(std::max<size_t>(blockSize, 64))
+{
+}
+
+void* Arena::allocateSlow(size_t bytes, size_t alignment) {
+    // Move on to the next kept block if it is big enough, otherwise add
+    // one; the extra bytes cover aligning the start
+    size_t needed = bytes + alignment;
+    size_t next = current < blocks.size() ? current + 1 : current;
+    while (next < blocks.size() && blocks[next].size < needed) {
+        next++;
+    }
+    if (next >= blocks.size()) {
+        Block block;
+        block.size = std::max(blockSize, needed);
+        block.data.reset(new uint8_t[block.size]);
+        blocks.push_back(std::move(block));
+        next = blocks.size() - 1;
+    }
+    
+    current = next;
+    offset = 0;
+    return allocate(bytes, alignment);
+}
+
+void Arena::reserve(size_t bytes) {
+    if (current < blocks.size() && offset + bytes <= blocks[current].size) return;
+    
+    // Start a block that holds everything at once
+    Block block;
+    block.size = std::max(blockSize, bytes);
+    block.data.reset(new uint8_t[block.size]);
+    blocks.push_back(std::move(block));
+    current = blocks.size() - 1;
+    offset = 0;
+}
+
+void Arena::reset() {
+    // Several blocks in use: replace them with one that holds the whole
+    // cycle, so the next one stays in a single block
+    if (blocks.size() > 1) {
+        size_t total = getCapacity();
+        blocks.clear();
+        Block block;
+        block.size = total;
+        block.data.reset(new uint8_t[total]);
+        blocks.push_back(std::move(block));
+    }
+    current = 0;
+    offset = 0;
+    used = 0;
+}
+
+void Arena::release() {
+    blocks.clear();
+    blocks.shrink_to_fit();
+    current = 0;
+    offset = 0;
+    used = 0;
+}
+
+size_t Arena::getCapacity() const {
+    size_t total = 0;
+    for (const Block& block : blocks) {
+        total += block.size;
+    }
+    return total;
+}
@@ -0,0 +1,131 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+/**
+ * Bump allocator for data that is thrown away all at once: the buffers of
+ * one load, or the scratch arrays of one frame. Allocating moves a pointer
+ * through the current block and freeing does nothing, so no allocation
+ * ever reaches the heap except for a new block.
+ *
+ * reset() rewinds the arena but keeps its memory; if the last cycle spilled
+ * into several blocks they are merged into one, so a steady workload stops
+ * touching the heap after its first cycles. release() gives everything back.
+ * Not thread-safe.
+ */
+class Arena {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+    
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    // alignment must be a power of two
+    void* allocate(size_t bytes, size_t alignment) {
+        if (current < blocks.size()) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(blocks[current].data.get());
+            size_t start = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+            if (start + bytes <= blocks[current].size) {
+                offset = start + bytes;
+                used += bytes;
+                return blocks[current].data.get() + start;
+            }
+        }
+        return allocateSlow(bytes, alignment);
+    }
+    
+    template <typename T>
+    T* allocateArray(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+    
+    // Make sure the next allocations of up to bytes in total fit in one block
+    void reserve(size_t bytes);
+    
+    // Everything allocated so far becomes invalid
+    void reset();
+    void release();
+    
+    size_t getBytesUsed() const { return used; }
+    size_t getCapacity() const;
+    
+private:
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+    
+    std::vector<Block> blocks;
+    size_t current;         // Block being allocated from
+    size_t offset;          // First free byte in it
+    size_t used;            // Bytes handed out since the last reset
+    size_t blockSize;
+    
+    void* allocateSlow(size_t bytes, size_t alignment);
+};
+
+/**
+ * Standard allocator drawing from an Arena, for containers that live no
+ * longer than the arena's current cycle:
+ *     ArenaVector<SDL_Rect> rects{ArenaAllocator<SDL_Rect>(&arena)};
+ * A default-constructed allocator uses the heap.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    
+    ArenaAllocator()
+        : arena(nullptr)
+    {
+    }
+    
+    explicit ArenaAllocator(Arena* arena)
+        : arena(arena)
+    {
+    }
+    
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : arena(other.getArena())
+    {
+    }
+    
+    T* allocate(size_t count) {
+        if (arena) return arena->allocateArray<T>(count);
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+    
+    void deallocate(T* pointer, size_t) {
+        if (!arena) ::operator delete(pointer);
+    }
+    
+    Arena* getArena() const { return arena; }
+    
+private:
+    Arena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() == b.getArena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.getArena() != b.getArena();
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // ARENA_H
@@ -0,0 +1,24 @@
+#ifndef AUDIO_EVENT_QUEUE_H
+#define AUDIO_EVENT_QUEUE_H
+
+#include <cstdint>
+#include "SpscQueue.h"
+
+// A synthesizer command stamped with the audio frame it takes effect on
+struct AudioEvent {
+    enum Type : uint8_t {
+        NOTE_ON,
+        NOTE_OFF,
+        ALL_NOTES_OFF
+    };
+    
+    uint64_t frame;     // Absolute output frame; past frames play at once
+    Type type;
+    uint8_t note;
+    uint8_t velocity;
+};
+
+// Events from one producer thread to the audio callback
+typedef SpscQueue<AudioEvent> AudioEventQueue;
+
+#endif // AUDIO_EVENT_QUEUE_H
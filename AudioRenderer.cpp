@@ -0,0 +1,162 @@
+#include "AudioRenderer.h"
+#include "NoteTimeline.h"
+#include "Synthesizer.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// Audio rendered after the last note ends, so the final releases fade out
+static const uint32_t TAIL_MS = 1000;
+
+// Largest block the synthesizer renders at once
+static const int BLOCK_FRAMES = 512;
+
+static const int CHANNELS = 2;
+
+static void writeLittleEndian(std::ostream& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+static void writeWavHeader(std::ostream& out, int sampleRate, uint64_t frames) {
+    uint32_t blockAlign = CHANNELS * sizeof(int16_t);
+    uint32_t dataSize = static_cast<uint32_t>(std::min<uint64_t>(frames * blockAlign, 0xFFFFFFFFu - 36));
+    
+    out.write("RIFF", 4);
+    writeLittleEndian(out, 36 + dataSize, 4);
+    out.write("WAVE", 4);
+    out.write("fmt ", 4);
+    writeLittleEndian(out, 16, 4);                  // PCM format chunk size
+    writeLittleEndian(out, 1, 2);                   // PCM
+    writeLittleEndian(out, CHANNELS, 2);
+    writeLittleEndian(out, sampleRate, 4);
+    writeLittleEndian(out, sampleRate * blockAlign, 4);
+    writeLittleEndian(out, blockAlign, 2);
+    writeLittleEndian(out, 16, 2);                  // Bits per sample
+    out.write("data", 4);
+    writeLittleEndian(out, dataSize, 4);
+}
+
+AudioRenderer::AudioRenderer()
+    : sampleRate(48000)
+{
+}
+
+void AudioRenderer::setSampleRate(int rate) {
+    sampleRate = std::max(8000, rate);
+}
+
+void AudioRenderer::playChunk(Synthesizer& synth, EventScheduler& scheduler,
+                              uint64_t start, int frames, float* output) const {
+    // Both passes split the chunk at exactly the same frames
+    int position = 0;
+    auto play = [&](int until) {
+        if (until <= position) return;
+        if (output) {
+            synth.render(output + static_cast<size_t>(position) * CHANNELS, until - position, CHANNELS);
+        } else {
+            synth.advance(until - position);
+        }
+        position = until;
+    };
+    
+    // Events whose frame falls before the end of the chunk, i.e. up to
+    // the last millisecond starting in it. Note-offs come first at equal
+    // times, so a repeated key releases the old note before the new one starts
+    uint64_t end = start + static_cast<uint64_t>(frames);
+    uint32_t lastMs = static_cast<uint32_t>((end * 1000 + sampleRate - 1) / sampleRate - 1);
+    scheduler.advance(lastMs, [&](const MidiEvent& event) {
+        uint64_t frame = static_cast<uint64_t>(event.time) * sampleRate / 1000;
+        play(static_cast<int>(frame - start));
+        if (event.isNoteOn) {
+            synth.noteOn(event.note, std::max<uint8_t>(event.velocity, 1));
+        } else {
+            synth.noteOff(event.note);
+        }
+    });
+    play(frames);
+}
+
+bool AudioRenderer::render(const NoteTimeline& timeline, const std::string& path) {
+    return render(timeline, path, ThreadPool::shared());
+}
+
+bool AudioRenderer::render(const NoteTimeline& timeline, const std::string& path, ThreadPool& pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << path << std::endl;
+        return false;
+    }
+    
+    uint64_t songMs = static_cast<uint64_t>(timeline.getDuration()) + TAIL_MS;
+    uint64_t totalFrames = songMs * sampleRate / 1000;
+    
+    // One second per chunk, independent of the thread count
+    const int chunkFrames = sampleRate;
+    size_t chunkCount = static_cast<size_t>((totalFrames + chunkFrames - 1) / chunkFrames);
+    size_t batchSize = pool.getThreadCount() * 2;
+    
+    Synthesizer control;
+    control.setSampleRate(sampleRate, BLOCK_FRAMES);
+    
+    EventScheduler events;
+    events.reset(&timeline);
+    
+    std::vector<Synthesizer> chunkSynths(batchSize);
+    std::vector<EventScheduler> chunkEvents(batchSize);
+    std::vector<float> samples(batchSize * chunkFrames * CHANNELS);
+    std::vector<uint8_t> pcm(samples.size() * sizeof(int16_t));
+    
+    std::cout << "Rendering " << songMs / 1000.0 << " s of audio at " << sampleRate << " Hz ("
+              << pool.getThreadCount() << " threads, " << control.getKernelName() << " mixing)"
+              << std::endl;
+    
+    auto startTime = std::chrono::steady_clock::now();
+    writeWavHeader(out, sampleRate, totalFrames);
+    
+    for (size_t first = 0; first < chunkCount; first += batchSize) {
+        size_t count = std::min(batchSize, chunkCount - first);
+        auto chunkStart = [&](size_t i) { return static_cast<uint64_t>(first + i) * chunkFrames; };
+        auto chunkLength = [&](size_t i) {
+            return static_cast<int>(std::min<uint64_t>(chunkFrames, totalFrames - chunkStart(i)));
+        };
+        
+        // Control pass: record where every chunk of the batch starts
+        for (size_t i = 0; i < count; i++) {
+            chunkSynths[i] = control;
+            chunkEvents[i] = events;
+            playChunk(control, events, chunkStart(i), chunkLength(i), nullptr);
+        }
+        
+        pool.parallelFor(count, [&](size_t i) {
+            playChunk(chunkSynths[i], chunkEvents[i], chunkStart(i), chunkLength(i),
+                      samples.data() + i * chunkFrames * CHANNELS);
+        });
+        
+        // Chunks are contiguous, so the batch is written in one piece
+        size_t sampleCount = static_cast<size_t>(chunkStart(count - 1) - chunkStart(0) +
+                                                 chunkLength(count - 1)) * CHANNELS;
+        // 16-bit little endian PCM
+        for (size_t i = 0; i < sampleCount; i++) {
+            float sample = std::max(-1.0f, std::min(samples[i], 1.0f));
+            uint16_t value = static_cast<uint16_t>(static_cast<int16_t>(std::lrint(sample * 32767.0f)));
+            pcm[i * 2] = static_cast<uint8_t>(value & 0xFF);
+            pcm[i * 2 + 1] = static_cast<uint8_t>(value >> 8);
+        }
+        
+        out.write(reinterpret_cast<const char*>(pcm.data()), sampleCount * 2);
+        if (!out) {
+            std::cerr << "Failed to write output file: " << path << std::endl;
+            return false;
+        }
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Rendered audio in " << seconds << " s ("
+              << songMs / 1000.0 / std::max(seconds, 1e-9) << "x real time)" << std::endl;
+    return true;
+}
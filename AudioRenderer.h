@@ -0,0 +1,46 @@
+#ifndef AUDIO_RENDERER_H
+#define AUDIO_RENDERER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "EventScheduler.h"
+
+class NoteTimeline;
+class Synthesizer;
+class ThreadPool;
+
+/**
+ * Renders a song's audio to a 16-bit stereo WAV file without a sound
+ * device. The song is cut into fixed one-second chunks that are
+ * synthesized in parallel. A sequential control pass first plays every
+ * note event and moves the voices forward without rendering them
+ * (Synthesizer::advance()), keeping a copy of the synthesizer and of the
+ * event cursor at each chunk boundary; each chunk then renders from its
+ * copies. Events are read straight from the timeline. Chunk boundaries do not
+ * depend on the number of threads, so the output is bit-identical however
+ * many threads render it.
+ */
+class AudioRenderer {
+public:
+    AudioRenderer();
+    
+    void setSampleRate(int rate);
+    int getSampleRate() const { return sampleRate; }
+    
+    // Render the whole song plus a release tail on the shared thread pool
+    bool render(const NoteTimeline& timeline, const std::string& path);
+    bool render(const NoteTimeline& timeline, const std::string& path, ThreadPool& pool);
+    
+private:
+    int sampleRate;
+    
+    // Play frames from start, applying the events due on the way; output
+    // is null for the control pass. The scheduler is left at the first
+    // event of the next chunk
+    void playChunk(Synthesizer& synth, EventScheduler& scheduler,
+                   uint64_t start, int frames, float* output) const;
+};
+
+#endif // AUDIO_RENDERER_H
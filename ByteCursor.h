@@ -0,0 +1,61 @@
+#ifndef BYTE_CURSOR_H
+#define BYTE_CURSOR_H
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Bounds-checked forward reader over a byte range.
+ * Every read fails (returns false) instead of running past the end, so a
+ * truncated or corrupt chunk cannot make the parser read outside the file.
+ */
+struct ByteCursor {
+    const uint8_t* data;
+    size_t pos;
+    size_t end;
+    
+    ByteCursor(const uint8_t* data, size_t begin, size_t end)
+        : data(data)
+        , pos(begin)
+        , end(end)
+    {
+    }
+    
+    bool atEnd() const { return pos >= end; }
+    size_t remaining() const { return pos < end ? end - pos : 0; }
+    
+    bool peekByte(uint8_t& value) const {
+        if (pos >= end) return false;
+        value = data[pos];
+        return true;
+    }
+    
+    bool readByte(uint8_t& value) {
+        if (pos >= end) return false;
+        value = data[pos++];
+        return true;
+    }
+    
+    // MIDI variable-length quantity, at most 4 bytes
+    bool readVariableLength(uint32_t& value) {
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            if (pos >= end) return false;
+            uint8_t byte = data[pos++];
+            value = (value << 7) | (byte & 0x7F);
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+    
+    bool skip(size_t count) {
+        if (count > remaining()) {
+            pos = end;
+            return false;
+        }
+        pos += count;
+        return true;
+    }
+};
+
+#endif // BYTE_CURSOR_H
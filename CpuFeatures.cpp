@@ -0,0 +1,54 @@
+#include "CpuFeatures.h"
+
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef CPU_FEATURES_X86
+
+bool CpuFeatures::hasSSE2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool CpuFeatures::hasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    
+    // AVX2 also needs the OS to save the YMM registers
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                      (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return false;
+#endif
+}
+
+#else
+
+bool CpuFeatures::hasSSE2() {
+    return false;
+}
+
+bool CpuFeatures::hasAVX2() {
+    return false;
+}
+
+#endif // CPU_FEATURES_X86
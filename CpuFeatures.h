@@ -0,0 +1,27 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_FEATURES_X86 1
+#include <immintrin.h>
+#endif
+
+// SIMD kernels are compiled for their instruction set regardless of the
+// global compiler flags; they may only run once the CPU has been checked
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+/**
+ * Runtime instruction set checks for the SIMD kernels (pixel blending,
+ * voice mixing). Always false on non-x86 targets.
+ */
+class CpuFeatures {
+public:
+    static bool hasSSE2();
+    static bool hasAVX2();
+};
+
+#endif // CPU_FEATURES_H
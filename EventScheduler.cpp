@@ -0,0 +1,62 @@
+#include "EventScheduler.h"
+#include <algorithm>
+
+EventScheduler::EventScheduler()
+    : events(nullptr)
+    , timeline(nullptr)
+    , cursor(0)
+    , releaseCursor(0)
+    , lastTime(0)
+{
+}
+
+void EventScheduler::reset(const std::vector<MidiEvent>* newEvents) {
+    events = newEvents;
+    timeline = nullptr;
+    cursor = 0;
+    releaseCursor = 0;
+    lastTime = 0;
+}
+
+void EventScheduler::reset(const NoteTimeline* newTimeline) {
+    events = nullptr;
+    timeline = newTimeline;
+    cursor = 0;
+    releaseCursor = 0;
+    lastTime = 0;
+}
+
+void EventScheduler::seek(uint32_t time) {
+    lastTime = time;
+    cursor = 0;
+    releaseCursor = 0;
+    
+    // Binary search for the first event that has not happened yet
+    if (timeline) {
+        const std::vector<uint32_t>& starts = timeline->getStarts();
+        const std::vector<uint32_t>& durations = timeline->getDurations();
+        const std::vector<uint32_t>& releases = timeline->getReleaseOrder();
+        
+        cursor = static_cast<size_t>(std::lower_bound(starts.begin(), starts.end(), time) - starts.begin());
+        auto release = std::lower_bound(releases.begin(), releases.end(), time,
+                                        [&](uint32_t index, uint32_t t) {
+                                            return starts[index] + durations[index] < t;
+                                        });
+        releaseCursor = static_cast<size_t>(release - releases.begin());
+    } else if (events) {
+        auto it = std::lower_bound(events->begin(), events->end(), time,
+                                   [](const MidiEvent& e, uint32_t t) { return e.time < t; });
+        cursor = static_cast<size_t>(it - events->begin());
+    }
+}
+
+void EventScheduler::rebase(size_t removed) {
+    cursor -= std::min(removed, cursor);
+}
+
+bool EventScheduler::isFinished() const {
+    if (timeline) {
+        return cursor >= timeline->size() && releaseCursor >= timeline->getReleaseOrder().size();
+    }
+    return !events || cursor >= events->size();
+}
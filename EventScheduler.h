@@ -0,0 +1,121 @@
+#ifndef EVENT_SCHEDULER_H
+#define EVENT_SCHEDULER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "NoteTimeline.h"
+
+// A single note on/off event on the playback timeline
+struct MidiEvent {
+    uint32_t time;      // Song time in milliseconds
+    uint8_t note;
+    uint8_t velocity;
+    bool isNoteOn;
+};
+
+/**
+ * Playback scheduler over a time-sorted event stream.
+ * Keeps a monotonic cursor so that each call to advance() only touches the
+ * events that became due since the previous call, i.e. the window
+ * (lastTime, now]. Jumping backwards (seek, speed change) is an O(log n)
+ * binary search instead of a rescan.
+ *
+ * The events come either from a list (the decoded window of a streamed
+ * file) or straight from a NoteTimeline: note-ons in its start order and
+ * note-offs in its release order, merged on the fly, so a loaded song
+ * needs no separate event list.
+ */
+class EventScheduler {
+public:
+    EventScheduler();
+    
+    // Attach a time-sorted event list and rewind to the beginning
+    void reset(const std::vector<MidiEvent>* events);
+    
+    // Attach the notes of a timeline and rewind to the beginning
+    void reset(const NoteTimeline* timeline);
+    
+    // Reposition the cursor so the next dispatched event is the first one
+    // at or after the given song time
+    void seek(uint32_t time);
+    
+    // The first removed events were dropped from the front of the list
+    void rebase(size_t removed);
+    
+    // Dispatch every event in (lastTime, now] (or [time, now] right after
+    // a seek) and advance the cursor.
+    // Calls with now < lastTime dispatch nothing; use seek() to go back.
+    template <typename Dispatch>
+    size_t advance(uint32_t now, Dispatch&& dispatch) {
+        if (now < lastTime) return 0;
+        if (timeline) return advanceNotes(now, dispatch);
+        if (!events) return 0;
+        
+        size_t dispatched = 0;
+        const size_t count = events->size();
+        while (cursor < count && (*events)[cursor].time <= now) {
+            dispatch((*events)[cursor]);
+            cursor++;
+            dispatched++;
+        }
+        lastTime = now;
+        return dispatched;
+    }
+    
+    uint32_t getLastTime() const { return lastTime; }
+    size_t getCursor() const { return cursor; }
+    bool isFinished() const;
+    
+private:
+    const std::vector<MidiEvent>* events;
+    const NoteTimeline* timeline;
+    size_t cursor;          // Next event in the list, or next note-on of the timeline
+    size_t releaseCursor;   // Next note-off in the timeline's release order
+    uint32_t lastTime;
+    
+    template <typename Dispatch>
+    size_t advanceNotes(uint32_t now, Dispatch& dispatch) {
+        const std::vector<uint32_t>& starts = timeline->getStarts();
+        const std::vector<uint32_t>& durations = timeline->getDurations();
+        const std::vector<uint32_t>& releases = timeline->getReleaseOrder();
+        
+        size_t dispatched = 0;
+        MidiEvent event;
+        while (true) {
+            // Zero-length notes have nothing to show on the keys
+            while (cursor < starts.size() && durations[cursor] == 0) cursor++;
+            
+            bool noteOnDue = cursor < starts.size() && starts[cursor] <= now;
+            uint32_t releaseTime = 0;
+            if (releaseCursor < releases.size()) {
+                uint32_t index = releases[releaseCursor];
+                releaseTime = starts[index] + durations[index];
+            }
+            bool noteOffDue = releaseCursor < releases.size() && releaseTime <= now;
+            if (!noteOnDue && !noteOffDue) break;
+            
+            // At equal times note-offs go first so that a re-struck key is
+            // released and pressed again rather than the reverse
+            if (noteOffDue && (!noteOnDue || releaseTime <= starts[cursor])) {
+                uint32_t index = releases[releaseCursor++];
+                event.time = releaseTime;
+                event.note = timeline->getKeys()[index];
+                event.velocity = 0;
+                event.isNoteOn = false;
+            } else {
+                event.time = starts[cursor];
+                event.note = timeline->getKeys()[cursor];
+                event.velocity = timeline->getVelocities()[cursor];
+                event.isNoteOn = true;
+                cursor++;
+            }
+            dispatch(static_cast<const MidiEvent&>(event));
+            dispatched++;
+        }
+        lastTime = now;
+        return dispatched;
+    }
+};
+
+#endif // EVENT_SCHEDULER_H
@@ -0,0 +1,46 @@
+#include "FrameBuffer.h"
+#include "SpanRasterizer.h"
+#include <algorithm>
+
+FrameBuffer::FrameBuffer(int width, int height)
+    : width(width)
+    , height(height)
+    , pixels(static_cast<size_t>(width) * height * 4)
+{
+}
+
+void FrameBuffer::clear(SDL_Color color) {
+    SpanRasterizer::fillRect(pixels.data(), 0, pixels.size() / 4, 1, color);
+}
+
+void FrameBuffer::fillRect(const SDL_Rect& rect, SDL_Color color) {
+    int x0 = std::max(rect.x, 0);
+    int y0 = std::max(rect.y, 0);
+    int x1 = std::min(rect.x + rect.w, width);
+    int y1 = std::min(rect.y + rect.h, height);
+    if (x0 >= x1 || y0 >= y1) return;
+    
+    // Blending with alpha 0 changes nothing and with alpha 255 is a plain copy
+    if (color.a == 0) return;
+    
+    uint8_t* corner = &pixels[(static_cast<size_t>(y0) * width + x0) * 4];
+    size_t stride = static_cast<size_t>(width) * 4;
+    if (color.a == 255) {
+        SpanRasterizer::fillRect(corner, stride, x1 - x0, y1 - y0, color);
+    } else {
+        SpanRasterizer::blendRect(corner, stride, x1 - x0, y1 - y0, color);
+    }
+}
+
+void FrameBuffer::drawRect(const SDL_Rect& rect, SDL_Color color) {
+    if (rect.w <= 0 || rect.h <= 0) return;
+    
+    fillRect({rect.x, rect.y, rect.w, 1}, color);
+    if (rect.h > 1) {
+        fillRect({rect.x, rect.y + rect.h - 1, rect.w, 1}, color);
+    }
+    fillRect({rect.x, rect.y + 1, 1, rect.h - 2}, color);
+    if (rect.w > 1) {
+        fillRect({rect.x + rect.w - 1, rect.y + 1, 1, rect.h - 2}, color);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * RGBA image in memory, for drawing frames without a window.
+ * Pixels are stored row by row as R, G, B, A bytes (SDL_PIXELFORMAT_RGBA32)
+ * and fillRect() blends like SDL_BLENDMODE_BLEND, so frames match what the
+ * SDL renderer would draw.
+ */
+class FrameBuffer {
+public:
+    FrameBuffer(int width, int height);
+    
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const uint8_t* data() const { return pixels.data(); }
+    size_t byteSize() const { return pixels.size(); }
+    
+    void clear(SDL_Color color);
+    // Rectangles are clipped to the image
+    void fillRect(const SDL_Rect& rect, SDL_Color color);
+    // One-pixel border, drawn like SDL_RenderDrawRect
+    void drawRect(const SDL_Rect& rect, SDL_Color color);
+    
+private:
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+};
+
+#endif // FRAME_BUFFER_H
@@ -0,0 +1,83 @@
+#ifndef FRAME_SNAPSHOT_H
+#define FRAME_SNAPSHOT_H
+
+#include <vector>
+#include <bitset>
+#include <cstdint>
+#include <algorithm>
+#include "NoteTimeline.h"
+#include "Arena.h"
+
+// One bit per MIDI note
+typedef std::bitset<128> KeyStates;
+
+// Playback state published by the simulation thread after every step
+struct FrameSnapshot {
+    uint32_t songTime;
+    float progress;     // Position in the song, 0 to 1
+    bool playing;
+    bool paused;
+    KeyStates keys;     // Keys held by the song
+    
+    FrameSnapshot()
+        : songTime(0)
+        , progress(0.0f)
+        , playing(false)
+        , paused(false)
+    {
+    }
+};
+
+/**
+ * Copy of the notes overlapping [from, to], taken by the simulation thread
+ * so the render thread never touches a timeline that is still being
+ * decoded. The window reaches a margin past the screen on both sides, so a
+ * copy taken a frame ago still covers the current view.
+ *
+ * The notes live in the window's own arena, which is rewound for every
+ * copy. A window belongs to one thread at a time, so the arena needs no
+ * locking.
+ */
+struct NoteWindow {
+    uint32_t from;
+    uint32_t to;
+    ArenaVector<NoteInterval> notes;
+    
+    NoteWindow()
+        : from(0)
+        , to(0)
+        , arena(64 * 1024)
+        , peakNotes(0)
+    {
+    }
+    
+    // Start a new copy of [newFrom, newTo], sized for the largest copy so far
+    void reset(uint32_t newFrom, uint32_t newTo) {
+        from = newFrom;
+        to = newTo;
+        peakNotes = std::max(peakNotes, notes.size());
+        notes = ArenaVector<NoteInterval>(ArenaAllocator<NoteInterval>(&arena));
+        arena.reset();
+        notes.reserve(peakNotes);
+    }
+    
+    bool covers(uint32_t rangeFrom, uint32_t rangeTo) const {
+        return from <= rangeFrom && rangeTo <= to;
+    }
+    
+    // Visit every copied interval overlapping [rangeFrom, rangeTo]
+    template <typename Visitor>
+    void forEachInRange(uint32_t rangeFrom, uint32_t rangeTo, Visitor&& visit) const {
+        for (const NoteInterval& note : notes) {
+            if (note.start <= rangeTo && note.end >= rangeFrom) {
+                visit(note);
+            }
+        }
+    }
+    
+private:
+    Arena arena;
+    size_t peakNotes;
+};
+
+#endif // FRAME_SNAPSHOT_H
@@ -0,0 +1,66 @@
+#ifndef MIDI_EVENT_READER_H
+#define MIDI_EVENT_READER_H
+
+#include "ByteCursor.h"
+#include <cstdint>
+
+// One decoded track event, with running status already resolved
+struct RawMidiEvent {
+    uint32_t delta;             // Ticks since the previous event
+    uint8_t status;             // Full status byte
+    uint8_t data1;              // First data byte (channel messages)
+    uint8_t data2;              // Second data byte, 0 if the message has one
+    uint8_t metaType;           // Meta event type (status 0xFF)
+    const uint8_t* payload;     // Meta / SysEx payload
+    uint32_t length;            // Payload length
+};
+
+/**
+ * Decodes the next event of a track.
+ * Returns false at the end of the track, or when the data is truncated or
+ * cannot be followed any further (no running status, unknown message).
+ */
+inline bool readMidiEvent(ByteCursor& cursor, uint8_t& runningStatus, RawMidiEvent& event) {
+    if (!cursor.readVariableLength(event.delta)) return false;
+    
+    uint8_t statusByte;
+    if (!cursor.peekByte(statusByte)) return false;
+    
+    // Handle running status
+    if (statusByte < 0x80) {
+        if (runningStatus == 0) return false; // Data byte without any status
+        statusByte = runningStatus;
+    } else {
+        cursor.skip(1);
+        if (statusByte < 0xF0) {
+            runningStatus = statusByte;
+        }
+    }
+    
+    event.status = statusByte;
+    event.data1 = 0;
+    event.data2 = 0;
+    event.metaType = 0;
+    event.payload = nullptr;
+    event.length = 0;
+    
+    uint8_t eventType = statusByte & 0xF0;
+    if (eventType == 0xC0 || eventType == 0xD0) { // Program change, channel aftertouch
+        return cursor.readByte(event.data1);
+    }
+    if (statusByte < 0xF0) { // Note off/on, aftertouch, control change, pitch bend
+        return cursor.readByte(event.data1) && cursor.readByte(event.data2);
+    }
+    
+    if (statusByte == 0xFF) { // Meta event
+        if (!cursor.readByte(event.metaType)) return false;
+    } else if (statusByte != 0xF0 && statusByte != 0xF7) {
+        return false; // Unknown system message
+    }
+    
+    if (!cursor.readVariableLength(event.length) || event.length > cursor.remaining()) return false;
+    event.payload = cursor.data + cursor.pos;
+    return cursor.skip(event.length);
+}
+
+#endif // MIDI_EVENT_READER_H
@@ -0,0 +1,140 @@
+#include "MidiInput.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+#ifdef WATERFALL_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// How often the input thread checks whether it should stop
+static const int POLL_TIMEOUT_MS = 100;
+
+MidiInput::MidiInput()
+    : sequencer(nullptr)
+    , port(-1)
+    , audio(nullptr)
+    , events(QUEUE_CAPACITY)
+    , stopping(false)
+{
+}
+
+MidiInput::~MidiInput() {
+    close();
+}
+
+uint64_t MidiInput::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#ifdef WATERFALL_HAVE_ALSA
+
+bool MidiInput::open(const std::string& source, AudioEventQueue* audioQueue) {
+    close();
+    
+    if (snd_seq_open(&sequencer, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0) {
+        std::cerr << "Could not open the ALSA sequencer" << std::endl;
+        sequencer = nullptr;
+        return false;
+    }
+    snd_seq_set_client_name(sequencer, "Waterfall Piano");
+    
+    port = snd_seq_create_simple_port(sequencer, "input",
+                                      SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                      SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    if (port < 0) {
+        std::cerr << "Could not create an ALSA sequencer port" << std::endl;
+        close();
+        return false;
+    }
+    
+    if (!source.empty()) {
+        snd_seq_addr_t address;
+        if (snd_seq_parse_address(sequencer, &address, source.c_str()) < 0 ||
+            snd_seq_connect_from(sequencer, port, address.client, address.port) < 0) {
+            std::cerr << "Could not connect MIDI input from " << source << std::endl;
+            close();
+            return false;
+        }
+    }
+    
+    audio = audioQueue;
+    stopping = false;
+    thread = std::thread(&MidiInput::inputLoop, this);
+    
+    std::cout << "MIDI input: ALSA port " << snd_seq_client_id(sequencer) << ":" << port;
+    if (!source.empty()) std::cout << " connected from " << source;
+    std::cout << std::endl;
+    return true;
+}
+
+void MidiInput::close() {
+    if (thread.joinable()) {
+        stopping = true;
+        thread.join();
+    }
+    if (sequencer) {
+        snd_seq_close(sequencer);
+        sequencer = nullptr;
+    }
+    port = -1;
+    audio = nullptr;
+}
+
+void MidiInput::inputLoop() {
+    // Best effort: without real-time rights the thread keeps its priority
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    
+    std::vector<pollfd> descriptors(snd_seq_poll_descriptors_count(sequencer, POLLIN));
+    snd_seq_poll_descriptors(sequencer, descriptors.data(),
+                             static_cast<unsigned int>(descriptors.size()), POLLIN);
+    
+    while (!stopping) {
+        if (poll(descriptors.data(), descriptors.size(), POLL_TIMEOUT_MS) <= 0) continue;
+        
+        // Drain everything that arrived; the sequencer is non-blocking
+        snd_seq_event_t* event = nullptr;
+        while (snd_seq_event_input(sequencer, &event) >= 0 && event) {
+            uint64_t received = now();
+            
+            bool noteOn = event->type == SND_SEQ_EVENT_NOTEON;
+            if (!noteOn && event->type != SND_SEQ_EVENT_NOTEOFF) continue;
+            
+            uint8_t note = event->data.note.note & 0x7F;
+            uint8_t velocity = noteOn ? (event->data.note.velocity & 0x7F) : 0;
+            
+            if (audio) {
+                AudioEvent sound;
+                sound.frame = 0;
+                sound.type = velocity > 0 ? AudioEvent::NOTE_ON : AudioEvent::NOTE_OFF;
+                sound.note = note;
+                sound.velocity = velocity;
+                audio->push(sound);
+            }
+            events.push({received, note, velocity});
+        }
+    }
+}
+
+#else
+
+bool MidiInput::open(const std::string& source, AudioEventQueue* audioQueue) {
+    (void)source;
+    (void)audioQueue;
+    std::cerr << "MIDI input needs ALSA, which this build does not have" << std::endl;
+    return false;
+}
+
+void MidiInput::close() {
+}
+
+void MidiInput::inputLoop() {
+}
+
+#endif // WATERFALL_HAVE_ALSA
@@ -0,0 +1,67 @@
+#ifndef MIDI_INPUT_H
+#define MIDI_INPUT_H
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include "SpscQueue.h"
+#include "AudioEventQueue.h"
+
+struct _snd_seq;
+
+// A live key change, stamped with the steady clock when it was received
+struct MidiInputEvent {
+    uint64_t receivedNs;
+    uint8_t note;
+    uint8_t velocity;   // 0 releases the key
+};
+
+/**
+ * Live MIDI input from an ALSA sequencer port.
+ * A dedicated thread waits on the sequencer and, for every note event,
+ * stamps the time of receipt and pushes it to two lock-free queues: one
+ * straight to the audio callback, so the note sounds at the next audio
+ * block without a trip through the UI thread, and one to the UI thread for
+ * the key highlight.
+ *
+ * The port ("Waterfall Piano:input") can be connected to from outside with
+ * aconnect, or open() connects it to a given source such as a hardware
+ * keyboard or an snd-virmidi port. Without ALSA (other platforms, or no
+ * libasound at build time) open() fails and the piano runs without it.
+ */
+class MidiInput {
+public:
+    static const size_t QUEUE_CAPACITY = 4096;
+    
+    MidiInput();
+    ~MidiInput();
+    
+    MidiInput(const MidiInput&) = delete;
+    MidiInput& operator=(const MidiInput&) = delete;
+    
+    // Create the input port and start the input thread. source is an ALSA
+    // address ("client:port" or a client name) to connect from, or empty.
+    // audio may be null when there is no sound device.
+    bool open(const std::string& source, AudioEventQueue* audio);
+    void close();
+    bool isOpen() const { return sequencer != nullptr; }
+    
+    // Consumed by the UI thread
+    SpscQueue<MidiInputEvent>& getEvents() { return events; }
+    
+    // Clock used for the receipt stamps, in nanoseconds
+    static uint64_t now();
+    
+private:
+    _snd_seq* sequencer;
+    int port;
+    AudioEventQueue* audio;
+    SpscQueue<MidiInputEvent> events;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    
+    void inputLoop();
+};
+
+#endif // MIDI_INPUT_H
@@ -1,33 +1,28 @@
 #include "MidiParser.h"
+#include "MappedFile.h"
+#include "MidiEventReader.h"
+#include "ThreadPool.h"
 #include <fstream>
 #include <iostream>
 #include <cstring>
 #include <algorithm>
+#include <queue>
+
+// Tempo changes a track holds before its buffer grows
+static const size_t INITIAL_TEMPO_CAPACITY = 16;
 
 MidiParser::MidiParser()
     : ticksPerQuarterNote(480)
     , totalDuration(0)
-    , tempo(500000) // Default: 120 BPM
+    , overlapPolicy(NotePairing::FIRST_IN_FIRST_OUT)
 {
 }
 
 MidiParser::~MidiParser() {
 }
 
-uint32_t MidiParser::readVariableLength(const uint8_t* data, size_t& offset) {
-    uint32_t value = 0;
-    uint8_t byte;
-    
-    do {
-        byte = data[offset++];
-        value = (value << 7) | (byte & 0x7F);
-    } while (byte & 0x80);
-    
-    return value;
-}
-
 uint32_t MidiParser::read32Bit(const uint8_t* data, size_t offset) {
-    return (data[offset] << 24) | (data[offset+1] << 16) | 
+    return (static_cast<uint32_t>(data[offset]) << 24) | (data[offset+1] << 16) |
            (data[offset+2] << 8) | data[offset+3];
 }
 
@@ -35,14 +30,33 @@ uint16_t MidiParser::read16Bit(const uint8_t* data, size_t offset) {
     return (data[offset] << 8) | data[offset+1];
 }
 
-uint32_t MidiParser::ticksToMilliseconds(uint32_t ticks) {
-    // Convert MIDI ticks to milliseconds
-    // tempo is in microseconds per quarter note
-    // ticksPerQuarterNote is ticks per quarter note
-    return (ticks * tempo) / (ticksPerQuarterNote * 1000);
+uint32_t MidiParser::convertTicksToMilliseconds(MidiTrack& track) const {
+    // Tracks are parsed with times and durations in ticks; now that every
+    // tempo change is known, map them through the global tempo map
+    for (auto& note : track.notes) {
+        uint32_t startTick = note.time;
+        note.time = tempoMap.ticksToMilliseconds(startTick);
+        if (note.duration > 0) {
+            uint64_t endTick = static_cast<uint64_t>(startTick) + note.duration;
+            note.duration = tempoMap.ticksToMilliseconds(endTick) - note.time;
+        }
+    }
+    
+    uint32_t trackDuration = 0;
+    for (const auto& note : track.notes) {
+        trackDuration = std::max(trackDuration, note.time + note.duration);
+    }
+    return trackDuration;
 }
 
 bool MidiParser::loadFile(const std::string& filename) {
+    // Parse straight out of a read-only mapping when possible
+    MappedFile mapped;
+    if (mapped.open(filename)) {
+        return loadFromMemory(mapped.data(), mapped.size());
+    }
+    
+    // Fall back to reading the file into memory
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     
     if (!file.is_open()) {
@@ -61,22 +75,83 @@ bool MidiParser::loadFile(const std::string& filename) {
     
     file.close();
     
-    // Parse MIDI file
-    size_t offset = 0;
-    
+    return loadFromMemory(data.data(), fileSize);
+}
+
+bool MidiParser::loadFromMemory(const uint8_t* data, size_t size) {
     // Parse header
-    if (!parseHeader(data.data(), fileSize)) {
+    if (!parseHeader(data, size)) {
         return false;
     }
-    offset = 14; // Header is always 14 bytes
     
-    // Parse tracks
+    // Tracks start right after the header chunk
+    size_t offset = 8 + static_cast<size_t>(read32Bit(data, 4));
+    
+    // Locate every track chunk first; the tracks are independent of each
+    // other, so they can then be decoded concurrently
+    std::vector<TrackChunk> chunks = scanTrackChunks(data, size, offset);
+    
+    // Arenas are not thread-safe, so each chunk gets its own, and a worker
+    // only ever allocates from the arena of the chunk it parses. Only note-ons
+    // are stored, and a note-on with its note-off takes at least 6 bytes
+    // (delta and two data bytes each under running status), so a block for
+    // one note per 6 bytes of the chunk holds every well-formed track. Notes
+    // that are never released, and tempo changes, which are rare, grow the
+    // buffers into further blocks.
     tracks.clear();
-    while (offset < fileSize) {
-        if (!parseTrack(data.data(), fileSize, offset)) {
-            break;
+    trackArenas.clear();
+    trackArenas.reserve(chunks.size());
+    
+    std::vector<MidiTrack> parsed(chunks.size());
+    std::vector<ArenaVector<TempoChange>> tempoChanges;
+    tempoChanges.reserve(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        size_t length = chunks[i].end - chunks[i].begin;
+        size_t noteCapacity = length / 6 + 1;
+        size_t tempoCapacity = INITIAL_TEMPO_CAPACITY;
+        size_t arenaBytes = noteCapacity * sizeof(MidiNote) + alignof(MidiNote) +
+                            tempoCapacity * sizeof(TempoChange) + alignof(TempoChange);
+        
+        // Small tracks get small blocks, and growing buffers at most default ones
+        size_t blockSize = Arena::DEFAULT_BLOCK_SIZE;
+        trackArenas.emplace_back(new Arena(std::min(arenaBytes, blockSize)));
+        Arena* arena = trackArenas.back().get();
+        arena->reserve(arenaBytes);
+        
+        parsed[i].notes = ArenaVector<MidiNote>(ArenaAllocator<MidiNote>(arena));
+        parsed[i].notes.reserve(noteCapacity);
+        tempoChanges.emplace_back(ArenaAllocator<TempoChange>(arena));
+        tempoChanges.back().reserve(tempoCapacity);
+    }
+    
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        parseTrack(data, chunks[i], parsed[i], tempoChanges[i]);
+    });
+    
+    // Tempo events may live in any track, so times are converted only
+    // once all of them have been collected (in track order, so that the
+    // result does not depend on thread scheduling)
+    for (const auto& changes : tempoChanges) {
+        for (const auto& change : changes) {
+            tempoMap.addTempoChange(change.tick, change.tempo);
         }
     }
+    tempoMap.finalize();
+    
+    std::vector<uint32_t> trackDurations(parsed.size());
+    pool.parallelFor(parsed.size(), [&](size_t i) {
+        trackDurations[i] = convertTicksToMilliseconds(parsed[i]);
+    });
+    
+    // Keep the tracks that contain notes, in file order
+    totalDuration = 0;
+    for (size_t i = 0; i < parsed.size(); i++) {
+        if (parsed[i].notes.empty()) continue;
+        totalDuration = std::max(totalDuration, trackDurations[i]);
+        tracks.push_back(std::move(parsed[i]));
+    }
+    std::cout << "Tempo segments: " << tempoMap.getSegmentCount() << std::endl;
     
     return !tracks.empty();
 }
@@ -94,175 +169,159 @@ bool MidiParser::parseHeader(const uint8_t* data, size_t size) {
     }
     
     uint32_t headerLength = read32Bit(data, 4);
+    if (headerLength < 6 || headerLength > size - 8) {
+        std::cerr << "Invalid MIDI header length: " << headerLength << std::endl;
+        return false;
+    }
+    
     uint16_t format = read16Bit(data, 8);
     uint16_t numTracks = read16Bit(data, 10);
-    ticksPerQuarterNote = read16Bit(data, 12);
+    uint16_t division = read16Bit(data, 12);
     
     std::cout << "MIDI Format: " << format << std::endl;
     std::cout << "Number of tracks: " << numTracks << std::endl;
-    std::cout << "Ticks per quarter note: " << ticksPerQuarterNote << std::endl;
+    
+    tempoMap.clear();
+    if (division & 0x8000) {
+        // SMPTE: negative frames per second in the high byte, ticks per frame in the low byte
+        uint8_t framesPerSecond = static_cast<uint8_t>(-static_cast<int8_t>(division >> 8));
+        uint8_t ticksPerFrame = division & 0xFF;
+        tempoMap.setSmpte(framesPerSecond, ticksPerFrame);
+        std::cout << "SMPTE timing: " << static_cast<int>(framesPerSecond) << " fps, "
+                  << static_cast<int>(ticksPerFrame) << " ticks per frame" << std::endl;
+    } else {
+        ticksPerQuarterNote = division;
+        tempoMap.setTicksPerQuarterNote(ticksPerQuarterNote);
+        std::cout << "Ticks per quarter note: " << ticksPerQuarterNote << std::endl;
+    }
     
     return true;
 }
 
-bool MidiParser::parseTrack(const uint8_t* data, size_t size, size_t& offset) {
-    if (offset + 8 > size) {
-        return false;
-    }
+std::vector<MidiParser::TrackChunk> MidiParser::scanTrackChunks(const uint8_t* data, size_t size,
+                                                                size_t offset) {
+    std::vector<TrackChunk> chunks;
     
-    // Check for "MTrk" signature
-    if (data[offset] != 'M' || data[offset+1] != 'T' || 
-        data[offset+2] != 'r' || data[offset+3] != 'k') {
-        std::cerr << "Invalid track header" << std::endl;
-        return false;
+    while (offset + 8 <= size) {
+        // Chunk types are four printable ASCII characters
+        bool validType = true;
+        for (size_t i = 0; i < 4; i++) {
+            validType = validType && data[offset+i] >= 0x20 && data[offset+i] < 0x7F;
+        }
+        if (!validType) {
+            std::cerr << "Invalid track header" << std::endl;
+            break;
+        }
+        
+        bool isTrack = data[offset] == 'M' && data[offset+1] == 'T' &&
+                       data[offset+2] == 'r' && data[offset+3] == 'k';
+        uint32_t chunkLength = read32Bit(data, offset + 4);
+        size_t begin = offset + 8;
+        
+        // A truncated last chunk is parsed up to the end of the file
+        size_t end = begin + std::min(static_cast<size_t>(chunkLength), size - begin);
+        
+        // Unknown chunk types are skipped as the format requires
+        if (isTrack) {
+            chunks.push_back({begin, end});
+        }
+        offset = end;
     }
     
-    offset += 4;
-    uint32_t trackLength = read32Bit(data, offset);
-    offset += 4;
-    
-    size_t trackEnd = offset + trackLength;
+    return chunks;
+}
+
+void MidiParser::parseTrack(const uint8_t* data, const TrackChunk& chunk,
+                            MidiTrack& track, ArenaVector<TempoChange>& tempoChanges) const {
+    ByteCursor cursor(data, chunk.begin, chunk.end);
     
-    MidiTrack track;
+    // Times are kept in ticks here and converted after all tracks are read
     uint32_t absoluteTime = 0;
     uint8_t runningStatus = 0;
     
-    // Track active notes for duration calculation
-    struct ActiveNote {
-        uint8_t note;
-        uint32_t startTime;
-        size_t noteIndex;
-    };
-    std::vector<ActiveNote> activeNotes;
+    // Sounding notes by channel and key, identified by their index in track.notes
+    NotePairing pairing(overlapPolicy);
     
-    while (offset < trackEnd && offset < size) {
-        // Read delta time
-        uint32_t deltaTime = readVariableLength(data, offset);
-        absoluteTime += deltaTime;
+    RawMidiEvent event;
+    while (readMidiEvent(cursor, runningStatus, event)) {
+        absoluteTime += event.delta;
         
-        if (offset >= size) break;
+        uint8_t eventType = event.status & 0xF0;
         
-        uint8_t statusByte = data[offset];
-        
-        // Handle running status
-        if (statusByte < 0x80) {
-            statusByte = runningStatus;
-        } else {
-            offset++;
-            runningStatus = statusByte;
-        }
-        
-        uint8_t eventType = statusByte & 0xF0;
-        uint8_t channel = statusByte & 0x0F;
-        
-        if (eventType == 0x90) { // Note On
-            if (offset + 1 >= size) break;
-            uint8_t note = data[offset++];
-            uint8_t velocity = data[offset++];
+        if (eventType == 0x90 || eventType == 0x80) { // Note on, note off
+            uint8_t channel = event.status & 0x0F;
             
-            MidiNote midiNote;
-            midiNote.time = ticksToMilliseconds(absoluteTime);
-            midiNote.note = note;
-            midiNote.velocity = velocity;
-            midiNote.isNoteOn = (velocity > 0);
-            midiNote.duration = 0;
+            uint8_t velocity = eventType == 0x90 ? event.data2 : 0;
             
+            // Velocity 0 is note off; a note-off only ends its note-on
+            uint64_t noteOn;
             if (velocity > 0) {
-                // Store for duration calculation
-                ActiveNote active;
-                active.note = note;
-                active.startTime = absoluteTime;
-                active.noteIndex = track.notes.size();
-                activeNotes.push_back(active);
-            } else {
-                // Velocity 0 is note off
-                // Find matching note on and calculate duration
-                for (auto it = activeNotes.begin(); it != activeNotes.end(); ++it) {
-                    if (it->note == note) {
-                        uint32_t duration = absoluteTime - it->startTime;
-                        track.notes[it->noteIndex].duration = ticksToMilliseconds(duration);
-                        activeNotes.erase(it);
-                        break;
-                    }
-                }
+                MidiNote midiNote;
+                midiNote.time = absoluteTime;
+                midiNote.note = event.data1;
+                midiNote.velocity = velocity;
+                midiNote.channel = channel;
+                midiNote.duration = 0;
+                pairing.noteOn(0, channel, midiNote.note, track.notes.size());
+                track.notes.push_back(midiNote);
+            } else if (pairing.noteOff(0, channel, event.data1, noteOn)) {
+                MidiNote& started = track.notes[static_cast<size_t>(noteOn)];
+                started.duration = absoluteTime - started.time;
             }
             
-            track.notes.push_back(midiNote);
-            
-        } else if (eventType == 0x80) { // Note Off
-            if (offset + 1 >= size) break;
-            uint8_t note = data[offset++];
-            uint8_t velocity = data[offset++];
-            
-            // Find matching note on and calculate duration
-            for (auto it = activeNotes.begin(); it != activeNotes.end(); ++it) {
-                if (it->note == note) {
-                    uint32_t duration = absoluteTime - it->startTime;
-                    track.notes[it->noteIndex].duration = ticksToMilliseconds(duration);
-                    activeNotes.erase(it);
-                    break;
-                }
+        } else if (event.status == 0xFF) { // Meta event
+            const uint8_t* payload = event.payload;
+            if (event.metaType == 0x51 && event.length == 3) { // Set tempo
+                uint32_t tempo = (payload[0] << 16) | (payload[1] << 8) | payload[2];
+                tempoChanges.push_back({absoluteTime, tempo});
+            } else if (event.metaType == 0x03 && event.length > 0) { // Track name
+                track.name = std::string(reinterpret_cast<const char*>(payload), event.length);
             }
-            
-            MidiNote midiNote;
-            midiNote.time = ticksToMilliseconds(absoluteTime);
-            midiNote.note = note;
-            midiNote.velocity = 0;
-            midiNote.isNoteOn = false;
-            midiNote.duration = 0;
-            track.notes.push_back(midiNote);
-            
-        } else if (eventType == 0xA0) { // Polyphonic aftertouch
-            offset += 2;
-        } else if (eventType == 0xB0) { // Control change
-            offset += 2;
-        } else if (eventType == 0xC0) { // Program change
-            offset += 1;
-        } else if (eventType == 0xD0) { // Channel aftertouch
-            offset += 1;
-        } else if (eventType == 0xE0) { // Pitch bend
-            offset += 2;
-        } else if (statusByte == 0xFF) { // Meta event
-            if (offset >= size) break;
-            uint8_t metaType = data[offset++];
-            uint32_t length = readVariableLength(data, offset);
-            
-            if (metaType == 0x51 && length == 3) { // Set tempo
-                tempo = (data[offset] << 16) | (data[offset+1] << 8) | data[offset+2];
-                std::cout << "Tempo change: " << tempo << " microseconds per quarter note" << std::endl;
-            } else if (metaType == 0x03 && length > 0) { // Track name
-                track.name = std::string(reinterpret_cast<const char*>(&data[offset]), length);
-            }
-            
-            offset += length;
-        } else if (statusByte == 0xF0 || statusByte == 0xF7) { // SysEx
-            uint32_t length = readVariableLength(data, offset);
-            offset += length;
         }
+        // Aftertouch, control changes, program changes, pitch bend and SysEx are skipped
     }
-    
-    if (!track.notes.empty()) {
-        tracks.push_back(track);
-        
-        // Update total duration
-        uint32_t trackDuration = track.notes.back().time + track.notes.back().duration;
-        totalDuration = std::max(totalDuration, trackDuration);
-    }
-    
-    offset = trackEnd;
-    return true;
 }
 
 std::vector<MidiNote> MidiParser::getAllNotes() const {
     std::vector<MidiNote> allNotes;
     
+    size_t noteCount = 0;
     for (const auto& track : tracks) {
-        allNotes.insert(allNotes.end(), track.notes.begin(), track.notes.end());
+        noteCount += track.notes.size();
     }
+    allNotes.reserve(noteCount);
     
-    // Sort by time
-    std::sort(allNotes.begin(), allNotes.end(),
-              [](const MidiNote& a, const MidiNote& b) { return a.time < b.time; });
+    // Each track is already in time order, so a k-way merge over the track
+    // heads replaces a full sort. Ties go to the lower track index.
+    struct Head {
+        uint32_t time;
+        uint32_t track;
+        size_t index;
+        bool operator>(const Head& other) const {
+            if (time != other.time) return time > other.time;
+            return track > other.track;
+        }
+    };
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    
+    for (size_t t = 0; t < tracks.size(); t++) {
+        if (!tracks[t].notes.empty()) {
+            heads.push({tracks[t].notes[0].time, static_cast<uint32_t>(t), 0});
+        }
+    }
+    
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        
+        const auto& notes = tracks[head.track].notes;
+        allNotes.push_back(notes[head.index]);
+        
+        if (++head.index < notes.size()) {
+            head.time = notes[head.index].time;
+            heads.push(head);
+        }
+    }
     
     return allNotes;
 }
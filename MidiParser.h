@@ -4,17 +4,21 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include "TempoMap.h"
+#include "NotePairing.h"
+#include "Arena.h"
 
+// A note-on; its note-off only sets the duration
 struct MidiNote {
-    uint32_t time;      // Time in milliseconds
+    uint32_t time;      // Time in milliseconds (ticks while parsing)
     uint8_t note;       // MIDI note number (0-127)
-    uint8_t velocity;   // Velocity (0-127)
-    bool isNoteOn;      // true for note on, false for note off
-    uint32_t duration;  // Duration in milliseconds (calculated)
+    uint8_t velocity;   // Velocity (1-127)
+    uint8_t channel;    // MIDI channel (0-15)
+    uint32_t duration;  // Duration in milliseconds (calculated, ticks while parsing)
 };
 
 struct MidiTrack {
-    std::vector<MidiNote> notes;
+    ArenaVector<MidiNote> notes;    // Carved from the parser's arena for this track
     std::string name;
 };
 
@@ -23,27 +27,55 @@ public:
     MidiParser();
     ~MidiParser();
     
+    // The tracks point into the parser's arenas
+    MidiParser(const MidiParser&) = delete;
+    MidiParser& operator=(const MidiParser&) = delete;
+    
     bool loadFile(const std::string& filename);
+    bool loadFromMemory(const uint8_t* data, size_t size);
     const std::vector<MidiTrack>& getTracks() const { return tracks; }
     std::vector<MidiNote> getAllNotes() const;
     
     uint16_t getTicksPerQuarterNote() const { return ticksPerQuarterNote; }
     uint32_t getTotalDuration() const { return totalDuration; }
+    const TempoMap& getTempoMap() const { return tempoMap; }
+    
+    // Which note-on a note-off ends when a key is struck again while sounding
+    void setOverlapPolicy(NotePairing::Policy policy) { overlapPolicy = policy; }
+    NotePairing::Policy getOverlapPolicy() const { return overlapPolicy; }
+    
+    // Byte range of one MTrk chunk's events
+    struct TrackChunk {
+        size_t begin;
+        size_t end;
+    };
+    
+    // Parsing helper functions
+    static uint32_t read32Bit(const uint8_t* data, size_t offset);
+    static uint16_t read16Bit(const uint8_t* data, size_t offset);
+    
+    // Locate the MTrk chunks that follow the header, skipping unknown chunk types
+    static std::vector<TrackChunk> scanTrackChunks(const uint8_t* data, size_t size, size_t offset);
     
 private:
+    // Every parse-time buffer comes from here and is freed with the parser.
+    // One arena per track chunk, since the chunks are parsed concurrently
+    std::vector<std::unique_ptr<Arena>> trackArenas;
     std::vector<MidiTrack> tracks;
     uint16_t ticksPerQuarterNote;
     uint32_t totalDuration;
-    uint32_t tempo; // microseconds per quarter note
+    TempoMap tempoMap;
+    NotePairing::Policy overlapPolicy;
     
-    // Parsing helper functions
-    uint32_t readVariableLength(const uint8_t* data, size_t& offset);
-    uint32_t read32Bit(const uint8_t* data, size_t offset);
-    uint16_t read16Bit(const uint8_t* data, size_t offset);
+    struct TempoChange {
+        uint32_t tick;
+        uint32_t tempo;
+    };
     
     bool parseHeader(const uint8_t* data, size_t size);
-    bool parseTrack(const uint8_t* data, size_t size, size_t& offset);
-    uint32_t ticksToMilliseconds(uint32_t ticks);
+    void parseTrack(const uint8_t* data, const TrackChunk& chunk,
+                    MidiTrack& track, ArenaVector<TempoChange>& tempoChanges) const;
+    uint32_t convertTicksToMilliseconds(MidiTrack& track) const;
 };
 
 #endif // MIDI_PARSER_H
@@ -0,0 +1,220 @@
+#include "MidiStream.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+MidiStream::MidiStream()
+    : totalTrackBytes(0)
+    , ticksPerQuarterNote(480)
+    , segmentTick(0)
+    , segmentScaledTime(0)
+    , tempo(TempoMap::DEFAULT_TEMPO)
+    , hasPending(false)
+{
+}
+
+bool MidiStream::open(const std::string& filename) {
+    close();
+    
+    if (!file.open(filename)) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        return false;
+    }
+    
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+    
+    if (size < 14 || data[0] != 'M' || data[1] != 'T' || data[2] != 'h' || data[3] != 'd') {
+        std::cerr << "Not a valid MIDI file (missing MThd header)" << std::endl;
+        close();
+        return false;
+    }
+    
+    uint32_t headerLength = MidiParser::read32Bit(data, 4);
+    if (headerLength < 6 || headerLength > size - 8) {
+        std::cerr << "Invalid MIDI header length: " << headerLength << std::endl;
+        close();
+        return false;
+    }
+    
+    uint16_t division = MidiParser::read16Bit(data, 12);
+    smpteMap.clear();
+    if (division & 0x8000) {
+        smpteMap.setSmpte(static_cast<uint8_t>(-static_cast<int8_t>(division >> 8)), division & 0xFF);
+    } else {
+        ticksPerQuarterNote = division > 0 ? division : 480;
+    }
+    
+    // Only the chunk boundaries are located up front
+    chunks = MidiParser::scanTrackChunks(data, size, 8 + static_cast<size_t>(headerLength));
+    totalTrackBytes = 0;
+    for (const auto& chunk : chunks) {
+        totalTrackBytes += chunk.end - chunk.begin;
+    }
+    
+    rewind();
+    return true;
+}
+
+void MidiStream::close() {
+    file.close();
+    chunks.clear();
+    tracks.clear();
+    heap.clear();
+    totalTrackBytes = 0;
+    hasPending = false;
+}
+
+void MidiStream::rewind() {
+    tracks.clear();
+    heap.clear();
+    hasPending = false;
+    
+    segmentTick = 0;
+    segmentScaledTime = 0;
+    tempo = TempoMap::DEFAULT_TEMPO;
+    
+    tracks.reserve(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        TrackState state = {ByteCursor(file.data(), chunks[i].begin, chunks[i].end), 0, 0, RawMidiEvent()};
+        tracks.push_back(state);
+        
+        if (advanceTrack(static_cast<uint32_t>(i))) {
+            heap.push_back({tracks[i].tick, static_cast<uint32_t>(i)});
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+}
+
+bool MidiStream::advanceTrack(uint32_t index) {
+    TrackState& track = tracks[index];
+    if (!readMidiEvent(track.cursor, track.runningStatus, track.event)) {
+        return false;
+    }
+    track.tick += track.event.delta;
+    return true;
+}
+
+uint32_t MidiStream::ticksToMilliseconds(uint64_t tick) const {
+    if (smpteMap.isSmpte()) {
+        return smpteMap.ticksToMilliseconds(tick);
+    }
+    
+    uint64_t microseconds = (segmentScaledTime + (tick - segmentTick) * tempo) / ticksPerQuarterNote;
+    uint64_t ms = microseconds / 1000;
+    return ms > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ms);
+}
+
+bool MidiStream::decodeNext(StreamEvent& out) {
+    while (!heap.empty()) {
+        // Take the earliest pending event across all tracks
+        std::pop_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+        uint32_t index = heap.back().track;
+        heap.pop_back();
+        
+        RawMidiEvent event = tracks[index].event;
+        uint64_t tick = tracks[index].tick;
+        
+        if (advanceTrack(index)) {
+            heap.push_back({tracks[index].tick, index});
+            std::push_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+        }
+        
+        uint8_t eventType = event.status & 0xF0;
+        
+        if (event.status == 0xFF && event.metaType == 0x51 && event.length == 3) {
+            // Events arrive in tick order, so the new tempo starts a new
+            // segment. Kept undivided, like TempoMap, so no rounding adds up
+            segmentScaledTime += (tick - segmentTick) * tempo;
+            segmentTick = tick;
+            uint32_t newTempo = (event.payload[0] << 16) | (event.payload[1] << 8) | event.payload[2];
+            if (newTempo > 0) tempo = newTempo;
+        } else if (eventType == 0x90 || eventType == 0x80) {
+            out.time = ticksToMilliseconds(tick);
+            out.note = event.data1;
+            out.velocity = eventType == 0x90 ? event.data2 : 0;
+            out.isNoteOn = out.velocity > 0;
+            out.channel = event.status & 0x0F;
+            out.track = static_cast<uint16_t>(index);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool MidiStream::next(StreamEvent& event) {
+    if (hasPending) {
+        event = pending;
+        hasPending = false;
+        return true;
+    }
+    return decodeNext(event);
+}
+
+bool MidiStream::peek(StreamEvent& event) {
+    if (!hasPending) {
+        if (!decodeNext(pending)) return false;
+        hasPending = true;
+    }
+    event = pending;
+    return true;
+}
+
+size_t MidiStream::pull(uint32_t untilTime, std::vector<StreamEvent>& out) {
+    size_t count = 0;
+    
+    for (;;) {
+        if (!hasPending) {
+            if (!decodeNext(pending)) break;
+            hasPending = true;
+        }
+        if (pending.time > untilTime) break;
+        
+        out.push_back(pending);
+        hasPending = false;
+        count++;
+    }
+    
+    return count;
+}
+
+float MidiStream::getProgress() const {
+    if (totalTrackBytes == 0) return 1.0f;
+    return static_cast<float>(getBytesConsumed()) / totalTrackBytes;
+}
+
+size_t MidiStream::getBytesConsumed() const {
+    size_t consumed = 0;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        consumed += tracks[i].cursor.pos - chunks[i].begin;
+    }
+    return consumed;
+}
+
+void MidiStream::save(Checkpoint& checkpoint) const {
+    // Cursors and pending events only point into the mapped file, so
+    // plain copies stay valid for as long as it is open
+    checkpoint.tracks.assign(tracks.begin(), tracks.end());
+    checkpoint.heap.assign(heap.begin(), heap.end());
+    checkpoint.segmentTick = segmentTick;
+    checkpoint.segmentScaledTime = segmentScaledTime;
+    checkpoint.tempo = tempo;
+    checkpoint.pending = pending;
+    checkpoint.hasPending = hasPending;
+}
+
+void MidiStream::restore(const Checkpoint& checkpoint) {
+    // Same sizes every time, so the vectors keep their capacity
+    tracks.assign(checkpoint.tracks.begin(), checkpoint.tracks.end());
+    heap.assign(checkpoint.heap.begin(), checkpoint.heap.end());
+    segmentTick = checkpoint.segmentTick;
+    segmentScaledTime = checkpoint.segmentScaledTime;
+    tempo = checkpoint.tempo;
+    pending = checkpoint.pending;
+    hasPending = checkpoint.hasPending;
+}
+
+size_t MidiStream::getCheckpointSize() const {
+    return sizeof(Checkpoint) + chunks.size() * (sizeof(TrackState) + sizeof(HeapEntry));
+}
@@ -0,0 +1,133 @@
+#ifndef MIDI_STREAM_H
+#define MIDI_STREAM_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "MappedFile.h"
+#include "ByteCursor.h"
+#include "MidiEventReader.h"
+#include "TempoMap.h"
+#include "MidiParser.h"
+#include "Arena.h"
+
+// A note on/off event produced by the streaming decoder
+struct StreamEvent {
+    uint32_t time;      // Song time in milliseconds
+    uint8_t note;
+    uint8_t velocity;
+    bool isNoteOn;
+    uint8_t channel;
+    uint16_t track;
+};
+
+/**
+ * Incremental MIDI decoder for files too large to parse up front.
+ * The file is memory-mapped and every track keeps its own cursor; events
+ * are merged across tracks by tick one at a time, so tempo changes are
+ * applied in order as they are met and no global pass is needed. Only the
+ * per-track cursors are held in memory, so the decoding position can be
+ * saved to a Checkpoint and resumed from later.
+ */
+class MidiStream {
+public:
+    MidiStream();
+    
+    bool open(const std::string& filename);
+    void close();
+    
+    // Restart decoding from the beginning of the file
+    void rewind();
+    
+    // Next note event in time order; false once every track is exhausted
+    bool next(StreamEvent& event);
+    
+    // The event next() would return, without consuming it
+    bool peek(StreamEvent& event);
+    
+    // Append every event with time <= untilTime; returns the number appended
+    size_t pull(uint32_t untilTime, std::vector<StreamEvent>& out);
+    
+    bool isOpen() const { return file.isOpen(); }
+    bool isFinished() const { return !hasPending && heap.empty(); }
+    size_t getFileSize() const { return file.size(); }
+    
+    // Fraction of the track data consumed so far (0..1)
+    float getProgress() const;
+    size_t getBytesConsumed() const;
+    size_t getTrackBytes() const { return totalTrackBytes; }
+    
+private:
+    struct TrackState {
+        ByteCursor cursor;
+        uint8_t runningStatus;
+        uint64_t tick;          // Absolute tick of the pending event
+        RawMidiEvent event;     // Decoded, not yet processed event
+    };
+    
+    // Min-heap entry ordered by tick, then track index
+    struct HeapEntry {
+        uint64_t tick;
+        uint32_t track;
+        bool operator>(const HeapEntry& other) const {
+            if (tick != other.tick) return tick > other.tick;
+            return track > other.track;
+        }
+    };
+    
+public:
+    // Decoding position: every track's cursor, the merge heap, the tempo
+    // segment and the look-ahead event. A few dozen bytes per track.
+    struct Checkpoint {
+        ArenaVector<TrackState> tracks;
+        ArenaVector<HeapEntry> heap;
+        uint64_t segmentTick;
+        uint64_t segmentScaledTime;
+        uint32_t tempo;
+        StreamEvent pending;
+        bool hasPending;
+        
+        explicit Checkpoint(Arena* arena = nullptr)
+            : tracks(ArenaAllocator<TrackState>(arena))
+            , heap(ArenaAllocator<HeapEntry>(arena))
+            , segmentTick(0)
+            , segmentScaledTime(0)
+            , tempo(TempoMap::DEFAULT_TEMPO)
+            , pending()
+            , hasPending(false)
+        {
+        }
+    };
+    
+    // Copy the position out, or resume decoding from one saved from this file
+    void save(Checkpoint& checkpoint) const;
+    void restore(const Checkpoint& checkpoint);
+    
+    // Bytes a checkpoint of this file takes
+    size_t getCheckpointSize() const;
+    
+private:
+    MappedFile file;
+    std::vector<MidiParser::TrackChunk> chunks;
+    std::vector<TrackState> tracks;
+    std::vector<HeapEntry> heap;
+    size_t totalTrackBytes;
+    
+    // Current tempo segment (metrical timing)
+    TempoMap smpteMap;
+    uint16_t ticksPerQuarterNote;
+    uint64_t segmentTick;
+    uint64_t segmentScaledTime;    // Start of the segment, in us * ticksPerQuarterNote
+    uint32_t tempo;
+    
+    // One event of look-ahead for pull()
+    StreamEvent pending;
+    bool hasPending;
+    
+    bool advanceTrack(uint32_t index);
+    uint32_t ticksToMilliseconds(uint64_t tick) const;
+    bool decodeNext(StreamEvent& event);
+};
+
+#endif // MIDI_STREAM_H
@@ -0,0 +1,131 @@
+#ifndef NOTE_PAIRING_H
+#define NOTE_PAIRING_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Matches note-offs to the note-ons they end, in O(1) per event.
+ * The sounding notes of every (lane, channel, key) form a linked list
+ * threaded through one shared node pool, so pairing never scans or shifts
+ * memory whatever the polyphony. A lane is the unit notes are paired
+ * within (the parser pairs one track at a time; the streaming decoder uses
+ * the track index). The 128 key slots of a lane and channel are allocated
+ * the first time it plays a note.
+ *
+ * When a key is struck again before it was released, the policy decides
+ * which of the stacked note-ons the next note-off ends.
+ */
+class NotePairing {
+public:
+    enum Policy {
+        FIRST_IN_FIRST_OUT,     // The oldest sounding note ends first (default)
+        LAST_IN_FIRST_OUT       // The newest sounding note ends first
+    };
+    
+    explicit NotePairing(Policy policy = FIRST_IN_FIRST_OUT)
+        : policy(policy)
+        , freeNode(NONE)
+        , openCount(0)
+    {
+    }
+    
+    // Forget every sounding note; the policy is kept
+    void clear() {
+        laneSlots.clear();
+        slots.clear();
+        nodes.clear();
+        freeNode = NONE;
+        openCount = 0;
+    }
+    
+    // Only change the policy while no notes are sounding
+    void setPolicy(Policy newPolicy) { policy = newPolicy; }
+    Policy getPolicy() const { return policy; }
+    
+    // Remember a note-on under the caller's id (an event index, a sequence number)
+    void noteOn(uint32_t lane, uint8_t channel, uint8_t key, uint64_t id) {
+        Slot& slot = getSlot(lane, channel, key);
+        
+        uint32_t node = freeNode;
+        if (node != NONE) {
+            freeNode = nodes[node].next;
+        } else {
+            node = static_cast<uint32_t>(nodes.size());
+            nodes.push_back(Node());
+        }
+        nodes[node].id = id;
+        nodes[node].next = NONE;
+        
+        // Note-offs always take the head: FIFO appends, LIFO prepends
+        if (slot.head == NONE) {
+            slot.head = slot.tail = node;
+        } else if (policy == FIRST_IN_FIRST_OUT) {
+            nodes[slot.tail].next = node;
+            slot.tail = node;
+        } else {
+            nodes[node].next = slot.head;
+            slot.head = node;
+        }
+        openCount++;
+    }
+    
+    // End a sounding note: the id of its note-on, or false if the key was not sounding
+    bool noteOff(uint32_t lane, uint8_t channel, uint8_t key, uint64_t& id) {
+        size_t block = static_cast<size_t>(lane) * 16 + (channel & 0x0F);
+        if (block >= laneSlots.size() || laneSlots[block] == NONE) return false;
+        
+        Slot& slot = slots[laneSlots[block] + (key & 0x7F)];
+        uint32_t node = slot.head;
+        if (node == NONE) return false;
+        
+        id = nodes[node].id;
+        slot.head = nodes[node].next;
+        if (slot.head == NONE) slot.tail = NONE;
+        
+        nodes[node].next = freeNode;
+        freeNode = node;
+        openCount--;
+        return true;
+    }
+    
+    // Notes struck but not yet released
+    size_t getOpenCount() const { return openCount; }
+    
+private:
+    static const uint32_t NONE = UINT32_MAX;
+    
+    struct Slot {
+        uint32_t head;
+        uint32_t tail;
+    };
+    
+    struct Node {
+        uint64_t id;
+        uint32_t next;
+    };
+    
+    Policy policy;
+    std::vector<uint32_t> laneSlots;    // First slot of each lane and channel, NONE until used
+    std::vector<Slot> slots;            // 128 per lane and channel in use
+    std::vector<Node> nodes;            // Sounding notes, plus a free list
+    uint32_t freeNode;
+    size_t openCount;
+    
+    Slot& getSlot(uint32_t lane, uint8_t channel, uint8_t key) {
+        size_t block = static_cast<size_t>(lane) * 16 + (channel & 0x0F);
+        if (block >= laneSlots.size()) {
+            uint32_t unused = NONE;  // resize() takes a reference
+            laneSlots.resize(block - block % 16 + 16, unused);
+        }
+        if (laneSlots[block] == NONE) {
+            Slot empty = {NONE, NONE};
+            laneSlots[block] = static_cast<uint32_t>(slots.size());
+            slots.resize(slots.size() + 128, empty);
+        }
+        return slots[laneSlots[block] + (key & 0x7F)];
+    }
+};
+
+#endif // NOTE_PAIRING_H
@@ -0,0 +1,183 @@
+#include "NoteTimeline.h"
+#include "MidiParser.h"
+#include <algorithm>
+#include <queue>
+
+NoteTimeline::NoteTimeline()
+    : duration(0)
+{
+}
+
+void NoteTimeline::clear() {
+    // Release the memory too; a timeline is filled once per song
+    std::vector<uint32_t>().swap(starts);
+    std::vector<uint32_t>().swap(durations);
+    std::vector<uint8_t>().swap(keys);
+    std::vector<uint8_t>().swap(velocities);
+    std::vector<uint8_t>().swap(channels);
+    std::vector<uint16_t>().swap(tracks);
+    std::vector<uint32_t>().swap(releaseOrder);
+    std::vector<uint32_t>().swap(longNotes);
+    std::vector<LongNode>().swap(longNodes);
+    std::vector<uint32_t>().swap(longByStart);
+    std::vector<uint32_t>().swap(longByEnd);
+    duration = 0;
+}
+
+void NoteTimeline::reserve(size_t count) {
+    starts.reserve(count);
+    durations.reserve(count);
+    keys.reserve(count);
+    velocities.reserve(count);
+    channels.reserve(count);
+    tracks.reserve(count);
+}
+
+void NoteTimeline::build(const MidiParser& parser) {
+    clear();
+    
+    const auto& trackList = parser.getTracks();
+    size_t noteCount = 0;
+    for (const auto& track : trackList) {
+        noteCount += track.notes.size();
+    }
+    reserve(noteCount);
+    
+    // The parser already matched note-offs to note-ons and stored the
+    // duration on the note-on, so each parsed note becomes one note. Every
+    // track is in time order, so merging the track heads appends the notes
+    // in start order without sorting; ties go to the lower track index.
+    struct Head {
+        uint32_t time;
+        uint32_t track;
+        size_t index;
+        bool operator>(const Head& other) const {
+            if (time != other.time) return time > other.time;
+            return track > other.track;
+        }
+    };
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    
+    auto pushNextNote = [&](uint32_t track, size_t index) {
+        const auto& notes = trackList[track].notes;
+        if (index < notes.size()) {
+            heads.push({notes[index].time, track, index});
+        }
+    };
+    for (size_t t = 0; t < trackList.size(); t++) {
+        pushNextNote(static_cast<uint32_t>(t), 0);
+    }
+    
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        
+        const MidiNote& note = trackList[head.track].notes[head.index];
+        add(note.time, note.duration, note.note, note.velocity, note.channel,
+            static_cast<uint16_t>(head.track));
+        pushNextNote(head.track, head.index + 1);
+    }
+    
+    finish();
+}
+
+void NoteTimeline::finish() {
+    releaseOrder.clear();
+    longNotes.clear();
+    longNodes.clear();
+    longByStart.clear();
+    longByEnd.clear();
+    duration = 0;
+    
+    // Sort (end, index) pairs packed in one integer: ties stay in start order
+    std::vector<uint64_t> ends;
+    ends.reserve(starts.size());
+    
+    for (size_t i = 0; i < starts.size(); i++) {
+        uint32_t end = starts[i] + durations[i];
+        duration = std::max(duration, end);
+        
+        if (durations[i] > 0) {
+            ends.push_back(static_cast<uint64_t>(end) << 32 | i);
+        }
+        if (durations[i] > LONG_NOTE_MS) {
+            longNotes.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    
+    if (!longNotes.empty()) {
+        longByStart.reserve(longNotes.size());
+        longByEnd.reserve(longNotes.size());
+        std::vector<uint32_t> pending(longNotes);
+        buildLongNode(pending);
+    }
+    
+    std::sort(ends.begin(), ends.end());
+    releaseOrder.resize(ends.size());
+    for (size_t i = 0; i < ends.size(); i++) {
+        releaseOrder[i] = static_cast<uint32_t>(ends[i]);
+    }
+}
+
+size_t NoteTimeline::lowerBoundStart(uint32_t time) const {
+    auto it = std::lower_bound(starts.begin(), starts.end(), time);
+    return static_cast<size_t>(it - starts.begin());
+}
+
+size_t NoteTimeline::firstLongStartingAt(uint32_t time) const {
+    auto it = std::lower_bound(longNotes.begin(), longNotes.end(), time,
+                               [this](uint32_t index, uint32_t t) { return starts[index] < t; });
+    return static_cast<size_t>(it - longNotes.begin());
+}
+
+uint32_t NoteTimeline::buildLongNode(std::vector<uint32_t>& notes) {
+    // The median endpoint as center leaves at most half the notes on
+    // either side, so the tree is O(log n) deep
+    std::vector<uint32_t> endpoints;
+    endpoints.reserve(notes.size() * 2);
+    for (uint32_t index : notes) {
+        endpoints.push_back(starts[index]);
+        endpoints.push_back(starts[index] + durations[index]);
+    }
+    auto median = endpoints.begin() + endpoints.size() / 2;
+    std::nth_element(endpoints.begin(), median, endpoints.end());
+    uint32_t center = *median;
+    
+    // notes is in start order, and each part keeps that order
+    std::vector<uint32_t> left;
+    std::vector<uint32_t> right;
+    uint32_t first = static_cast<uint32_t>(longByStart.size());
+    for (uint32_t index : notes) {
+        if (starts[index] + durations[index] < center) {
+            left.push_back(index);
+        } else if (starts[index] > center) {
+            right.push_back(index);
+        } else {
+            longByStart.push_back(index);
+            longByEnd.push_back(index);
+        }
+    }
+    std::stable_sort(longByEnd.begin() + first, longByEnd.end(), [this](uint32_t a, uint32_t b) {
+        return starts[a] + durations[a] > starts[b] + durations[b];
+    });
+    
+    uint32_t node = static_cast<uint32_t>(longNodes.size());
+    LongNode entry;
+    entry.center = center;
+    entry.first = first;
+    entry.count = static_cast<uint32_t>(longByStart.size()) - first;
+    entry.left = NO_NODE;
+    entry.right = NO_NODE;
+    longNodes.push_back(entry);
+    
+    std::vector<uint32_t>().swap(notes);
+    if (!left.empty()) {
+        uint32_t child = buildLongNode(left);
+        longNodes[node].left = child;
+    }
+    if (!right.empty()) {
+        uint32_t child = buildLongNode(right);
+        longNodes[node].right = child;
+    }
+    return node;
+}
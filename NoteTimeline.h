@@ -0,0 +1,171 @@
+#ifndef NOTE_TIMELINE_H
+#define NOTE_TIMELINE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class MidiParser;
+
+// A complete note: key held from start to end (both in song milliseconds).
+// 16 bytes; the timeline stores its fields in separate arrays and hands out
+// these records by value
+struct NoteInterval {
+    uint32_t start;
+    uint32_t end;
+    uint8_t key;
+    uint8_t velocity;
+    uint8_t channel;
+    uint16_t track;
+};
+
+/**
+ * Immutable, start-sorted note store built once at load time.
+ * Notes are kept as a struct of arrays: start and duration as 32-bit
+ * milliseconds, key, velocity and channel as bytes and a 16-bit track, so
+ * range queries scan tightly packed start times and only touch the other
+ * fields of notes they visit. This is the only full copy of the song in
+ * memory; playback, rendering and exports all read from it.
+ *
+ * Viewport queries use binary search, so their cost depends on the number of
+ * notes near the queried window rather than on the length of the song.
+ * Short notes are found by searching the start times in [from - LONG_NOTE_MS, to].
+ * Long notes overlapping the window either start inside it, found by their
+ * own start order, or are sounding at from, found in a static interval tree:
+ * every note is stored at the highest node whose center it contains, sorted
+ * both ways, so a query only looks at the notes it reports plus one per
+ * level. However long a sustained note is, it costs one visit.
+ * A second index lists the notes by end time, for dispatching note-offs.
+ */
+class NoteTimeline {
+public:
+    static const uint32_t LONG_NOTE_MS = 4000;
+    
+    NoteTimeline();
+    
+    // Pair the parser's note-on events into notes and index them
+    void build(const MidiParser& parser);
+    void clear();
+    
+    // Fill the store directly (e.g. from the song cache): add notes in
+    // start order, then call finish() to build the indexes
+    void reserve(size_t count);
+    void add(uint32_t start, uint32_t length, uint8_t key, uint8_t velocity, uint8_t channel, uint16_t track) {
+        starts.push_back(start);
+        durations.push_back(length);
+        keys.push_back(key);
+        velocities.push_back(velocity);
+        channels.push_back(channel);
+        tracks.push_back(track);
+    }
+    void finish();
+    
+    // Visit every note overlapping [from, to]. Returns the number of notes
+    // looked at, which is what a query costs
+    template <typename Visitor>
+    size_t forEachInRange(uint32_t from, uint32_t to, Visitor&& visit) const {
+        size_t scanned = 0;
+        
+        // Short notes: anything overlapping must have started after from - LONG_NOTE_MS
+        uint32_t searchFrom = from > LONG_NOTE_MS ? from - LONG_NOTE_MS : 0;
+        for (size_t i = lowerBoundStart(searchFrom); i < starts.size(); ++i, ++scanned) {
+            if (starts[i] > to) break;
+            if (durations[i] <= LONG_NOTE_MS && starts[i] + durations[i] >= from) {
+                visit(getNote(i));
+            }
+        }
+        
+        // Long notes starting inside the window
+        for (size_t i = firstLongStartingAt(from); i < longNotes.size(); ++i, ++scanned) {
+            uint32_t index = longNotes[i];
+            if (starts[index] > to) break;
+            visit(getNote(index));
+        }
+        
+        // Long notes that started earlier and still sound at from. Each node
+        // holds the notes containing its center: left of it, those starting
+        // before from do; right of it, those ending at from or later
+        uint32_t node = longNodes.empty() ? NO_NODE : 0;
+        while (node != NO_NODE) {
+            const LongNode& current = longNodes[node];
+            const uint32_t* first = &longByStart[current.first];
+            if (from < current.center) {
+                for (uint32_t k = 0; k < current.count; k++, scanned++) {
+                    if (starts[first[k]] >= from) break;
+                    visit(getNote(first[k]));
+                }
+                node = current.left;
+            } else {
+                first = &longByEnd[current.first];
+                for (uint32_t k = 0; k < current.count; k++, scanned++) {
+                    uint32_t index = first[k];
+                    if (starts[index] + durations[index] < from) break;
+                    if (starts[index] < from) {
+                        visit(getNote(index));
+                    }
+                }
+                node = from > current.center ? current.right : NO_NODE;
+            }
+            scanned++;
+        }
+        return scanned;
+    }
+    
+    NoteInterval getNote(size_t index) const {
+        NoteInterval note;
+        note.start = starts[index];
+        note.end = starts[index] + durations[index];
+        note.key = keys[index];
+        note.velocity = velocities[index];
+        note.channel = channels[index];
+        note.track = tracks[index];
+        return note;
+    }
+    
+    // Columns, indexed like getNote()
+    const std::vector<uint32_t>& getStarts() const { return starts; }
+    const std::vector<uint32_t>& getDurations() const { return durations; }
+    const std::vector<uint8_t>& getKeys() const { return keys; }
+    const std::vector<uint8_t>& getVelocities() const { return velocities; }
+    const std::vector<uint8_t>& getChannels() const { return channels; }
+    const std::vector<uint16_t>& getTracks() const { return tracks; }
+    
+    // Indices of the notes longer than zero, by end time (ties in start order)
+    const std::vector<uint32_t>& getReleaseOrder() const { return releaseOrder; }
+    
+    size_t size() const { return starts.size(); }
+    bool empty() const { return starts.empty(); }
+    uint32_t getDuration() const { return duration; }
+    
+private:
+    // Sorted by start time
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> durations;
+    std::vector<uint8_t> keys;
+    std::vector<uint8_t> velocities;
+    std::vector<uint8_t> channels;
+    std::vector<uint16_t> tracks;
+    
+    // Interval tree node over the long notes containing center
+    struct LongNode {
+        uint32_t center;
+        uint32_t first;     // Its notes in longByStart and longByEnd
+        uint32_t count;
+        uint32_t left;      // Notes ending before center
+        uint32_t right;     // Notes starting after center
+    };
+    static const uint32_t NO_NODE = UINT32_MAX;
+    
+    std::vector<uint32_t> releaseOrder;    // Indices of sounding notes, by end time
+    std::vector<uint32_t> longNotes;       // Indices of long notes, by start time
+    std::vector<LongNode> longNodes;       // Interval tree over longNotes, root first
+    std::vector<uint32_t> longByStart;     // Each node's notes, by ascending start
+    std::vector<uint32_t> longByEnd;       // The same notes, by descending end
+    uint32_t duration;
+    
+    size_t lowerBoundStart(uint32_t time) const;
+    size_t firstLongStartingAt(uint32_t time) const;
+    uint32_t buildLongNode(std::vector<uint32_t>& notes);
+};
+
+#endif // NOTE_TIMELINE_H
@@ -0,0 +1,173 @@
+#include "OfflineRenderer.h"
+#include "NoteTimeline.h"
+#include "FrameBuffer.h"
+#include "ThreadPool.h"
+#include "SpanRasterizer.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+// Frames rendered after the last note ends, so the final notes finish falling
+static const uint32_t TAIL_MS = 1000;
+
+OfflineRenderer::OfflineRenderer()
+    : frameRate(60)
+    , scrollSpeed(DEFAULT_SCROLL_SPEED)
+    , keys(PianoLayout::createKeys())
+{
+    std::fill(keyIndex, keyIndex + 128, -1);
+    for (size_t i = 0; i < keys.size(); i++) {
+        keyIndex[keys[i].midiNote] = static_cast<int>(i);
+    }
+}
+
+void OfflineRenderer::setFrameRate(int framesPerSecond) {
+    frameRate = std::max(1, framesPerSecond);
+}
+
+void OfflineRenderer::renderFrame(const NoteTimeline& timeline, uint32_t time,
+                                  FrameBuffer& frame) const {
+    frame.clear(COLOR_BACKGROUND);
+    
+    // Guide lines
+    for (const auto& key : keys) {
+        if (!key.isBlack) {
+            int x = key.rect.x + key.rect.w / 2;
+            frame.fillRect({x, 0, 1, WATERFALL_HEIGHT}, COLOR_GUIDE_LINE);
+        }
+    }
+    
+    // Falling notes, laid out exactly like the interactive view; a key is
+    // pressed while one of its notes spans the current time
+    Uint32 lookAhead = static_cast<Uint32>(WATERFALL_HEIGHT / scrollSpeed * 1000);
+    float pixelsPerMs = scrollSpeed / 1000.0f;
+    bool pressed[128] = {};
+    
+    timeline.forEachInRange(time, time + lookAhead, [&](const NoteInterval& note) {
+        int index = keyIndex[note.key & 0x7F];
+        if (index < 0) return;
+        
+        const PianoKey& key = keys[index];
+        if (note.start <= time && note.end > time) {
+            pressed[note.key & 0x7F] = true;
+        }
+        
+        // Notes that already started extend below the waterfall; clamp them
+        float startOffset = (static_cast<int64_t>(note.start) - time) * pixelsPerMs;
+        float endOffset = (static_cast<int64_t>(note.end) - time) * pixelsPerMs;
+        int yBottom = std::min(WATERFALL_HEIGHT, WATERFALL_HEIGHT - static_cast<int>(startOffset));
+        int yTop = std::max(0, WATERFALL_HEIGHT - static_cast<int>(endOffset));
+        
+        SDL_Rect noteRect;
+        noteRect.x = key.rect.x + 2;
+        noteRect.y = yTop;
+        noteRect.w = key.rect.w - 4;
+        noteRect.h = std::max(1, yBottom - yTop);
+        
+        frame.fillRect(noteRect, PianoLayout::getNoteColor(note.velocity));
+    });
+    
+    // Keyboard: white keys, their outlines, then black keys on top
+    for (const auto& key : keys) {
+        if (!key.isBlack) {
+            frame.fillRect(key.rect, pressed[key.midiNote] ? COLOR_WHITE_PRESSED : COLOR_WHITE_KEY);
+            frame.drawRect(key.rect, COLOR_BLACK_KEY);
+        }
+    }
+    for (const auto& key : keys) {
+        if (key.isBlack) {
+            frame.fillRect(key.rect, pressed[key.midiNote] ? COLOR_BLACK_PRESSED : COLOR_BLACK_KEY);
+        }
+    }
+}
+
+bool OfflineRenderer::render(const NoteTimeline& timeline, const std::string& output,
+                             OutputFormat format) {
+    uint64_t songLength = static_cast<uint64_t>(timeline.getDuration()) + TAIL_MS;
+    size_t frameCount = static_cast<size_t>(songLength * frameRate / 1000) + 1;
+    
+    std::ofstream rawOut;
+    if (format == RAW_RGBA) {
+        rawOut.open(output, std::ios::binary | std::ios::trunc);
+        if (!rawOut.is_open()) {
+            std::cerr << "Failed to open output file: " << output << std::endl;
+            return false;
+        }
+    }
+    
+    // Each worker draws whole frames; a batch is written out before the
+    // next one starts, so memory use does not grow with the song length
+    ThreadPool& pool = ThreadPool::shared();
+    size_t batchSize = pool.getThreadCount() * 2;
+    std::vector<FrameBuffer> frames(batchSize, FrameBuffer(SCREEN_WIDTH, SCREEN_HEIGHT));
+    
+    std::cout << "Rendering " << frameCount << " frames at " << frameRate << " fps ("
+              << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << ", "
+              << pool.getThreadCount() << " threads, "
+              << SpanRasterizer::getKernelName() << " blending)" << std::endl;
+    
+    auto startTime = std::chrono::steady_clock::now();
+    
+    for (size_t first = 0; first < frameCount; first += batchSize) {
+        size_t count = std::min(batchSize, frameCount - first);
+        
+        pool.parallelFor(count, [&](size_t i) {
+            uint32_t time = static_cast<uint32_t>((first + i) * 1000 / frameRate);
+            renderFrame(timeline, time, frames[i]);
+        });
+        
+        for (size_t i = 0; i < count; i++) {
+            if (format == RAW_RGBA) {
+                rawOut.write(reinterpret_cast<const char*>(frames[i].data()), frames[i].byteSize());
+                if (!rawOut) {
+                    std::cerr << "Failed to write output file: " << output << std::endl;
+                    return false;
+                }
+            } else {
+                char number[16];
+                std::snprintf(number, sizeof(number), "_%06zu.ppm", first + i);
+                if (!writePpm(output + number, frames[i])) {
+                    return false;
+                }
+            }
+        }
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double songSeconds = songLength / 1000.0;
+    std::cout << "Rendered " << frameCount << " frames in " << seconds << " s ("
+              << frameCount / std::max(seconds, 1e-9) << " fps, "
+              << songSeconds / std::max(seconds, 1e-9) << "x real time)" << std::endl;
+    
+    return true;
+}
+
+bool OfflineRenderer::writePpm(const std::string& path, const FrameBuffer& frame) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open output file: " << path << std::endl;
+        return false;
+    }
+    
+    // Binary PPM holds RGB only; frames are opaque, so alpha is dropped
+    file << "P6\n" << frame.getWidth() << " " << frame.getHeight() << "\n255\n";
+    
+    std::vector<uint8_t> row(static_cast<size_t>(frame.getWidth()) * 3);
+    const uint8_t* pixel = frame.data();
+    for (int y = 0; y < frame.getHeight(); y++) {
+        for (int x = 0; x < frame.getWidth(); x++, pixel += 4) {
+            row[x * 3] = pixel[0];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[2];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    
+    if (!file) {
+        std::cerr << "Failed to write output file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
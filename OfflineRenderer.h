@@ -0,0 +1,46 @@
+#ifndef OFFLINE_RENDERER_H
+#define OFFLINE_RENDERER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "PianoLayout.h"
+
+class NoteTimeline;
+class FrameBuffer;
+
+/**
+ * Renders a song to video frames without a window or a real-time clock.
+ * Frames are sampled at a fixed frame rate and drawn in software. A frame
+ * depends only on its song time, so batches of whole frames are drawn in
+ * parallel on the shared thread pool and then written out in order.
+ */
+class OfflineRenderer {
+public:
+    enum OutputFormat {
+        RAW_RGBA,       // All frames back to back in one file
+        PPM_FILES       // One numbered .ppm image per frame
+    };
+    
+    OfflineRenderer();
+    
+    void setFrameRate(int framesPerSecond);
+    int getFrameRate() const { return frameRate; }
+    
+    // Render the whole song plus a short tail; output is a file (RAW_RGBA)
+    // or a path prefix for the numbered images (PPM_FILES)
+    bool render(const NoteTimeline& timeline, const std::string& output, OutputFormat format);
+    
+    // Draw the picture at the given song time
+    void renderFrame(const NoteTimeline& timeline, uint32_t time, FrameBuffer& frame) const;
+    
+private:
+    int frameRate;
+    float scrollSpeed;
+    std::vector<PianoKey> keys;
+    int keyIndex[128];              // MIDI note -> index in keys, or -1
+    
+    static bool writePpm(const std::string& path, const FrameBuffer& frame);
+};
+
+#endif // OFFLINE_RENDERER_H
@@ -0,0 +1,89 @@
+#include "PianoLayout.h"
+
+std::vector<PianoKey> PianoLayout::createKeys() {
+    std::vector<PianoKey> keys;
+    
+    int whiteKeyCount = 0;
+    
+    for (int i = 0; i < TOTAL_KEYS; i++) {
+        int midiNote = FIRST_MIDI_NOTE + i;
+        PianoKey key;
+        key.midiNote = midiNote;
+        key.isBlack = isBlackKey(midiNote);
+        key.pressed = false;
+        
+        if (!key.isBlack) {
+            key.whiteKeyIndex = whiteKeyCount;
+            whiteKeyCount++;
+        }
+        
+        keys.push_back(key);
+    }
+    
+    // Position white keys
+    for (auto& key : keys) {
+        if (!key.isBlack) {
+            key.rect.x = key.whiteKeyIndex * WHITE_KEY_WIDTH;
+            key.rect.y = WATERFALL_HEIGHT;
+            key.rect.w = WHITE_KEY_WIDTH - 2;
+            key.rect.h = WHITE_KEY_HEIGHT;
+        }
+    }
+    
+    // Position black keys (on top of white keys)
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i].isBlack && i > 0) {
+            // Find adjacent white key
+            int whiteIdx = keys[i-1].whiteKeyIndex;
+            keys[i].rect.x = whiteIdx * WHITE_KEY_WIDTH + WHITE_KEY_WIDTH - BLACK_KEY_WIDTH / 2;
+            keys[i].rect.y = WATERFALL_HEIGHT;
+            keys[i].rect.w = BLACK_KEY_WIDTH;
+            keys[i].rect.h = BLACK_KEY_HEIGHT;
+        }
+    }
+    
+    return keys;
+}
+
+bool PianoLayout::isBlackKey(int midiNote) {
+    int noteInOctave = midiNote % 12;
+    return (noteInOctave == 1 || noteInOctave == 3 || noteInOctave == 6 || 
+            noteInOctave == 8 || noteInOctave == 10);
+}
+
+int PianoLayout::getWhiteKeyIndex(int midiNote) {
+    int whiteKeyCount = 0;
+    for (int i = FIRST_MIDI_NOTE; i <= midiNote; i++) {
+        if (!isBlackKey(i)) {
+            if (i == midiNote) return whiteKeyCount;
+            whiteKeyCount++;
+        }
+    }
+    return whiteKeyCount;
+}
+
+// Color gradient based on velocity, one entry per velocity
+static std::vector<SDL_Color> buildNotePalette() {
+    std::vector<SDL_Color> palette(128);
+    for (int velocity = 0; velocity < 128; velocity++) {
+        float normalizedVel = velocity / 127.0f;
+        
+        if (normalizedVel < 0.33f) {
+            // Blue to cyan
+            palette[velocity] = {100, 150, 255, 200};
+        } else if (normalizedVel < 0.66f) {
+            // Cyan to green
+            palette[velocity] = {100, 255, 150, 200};
+        } else {
+            // Green to yellow
+            palette[velocity] = {255, 220, 100, 200};
+        }
+    }
+    return palette;
+}
+
+SDL_Color PianoLayout::getNoteColor(int velocity) {
+    // Notes store no color; drawing one is a table lookup
+    static const std::vector<SDL_Color> palette = buildNotePalette();
+    return palette[velocity & 0x7F];
+}
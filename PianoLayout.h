@@ -0,0 +1,59 @@
+#ifndef PIANO_LAYOUT_H
+#define PIANO_LAYOUT_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Piano constants
+const int TOTAL_KEYS = 88;
+const int FIRST_MIDI_NOTE = 21;  // A0
+const int LAST_MIDI_NOTE = 108;   // C8
+const int WHITE_KEYS = 52;
+const int BLACK_KEYS = 36;
+
+// Display constants
+const int SCREEN_WIDTH = 1600;
+const int SCREEN_HEIGHT = 900;
+const int KEYBOARD_HEIGHT = 150;
+const int WATERFALL_HEIGHT = SCREEN_HEIGHT - KEYBOARD_HEIGHT;
+const float DEFAULT_SCROLL_SPEED = 200.0f; // Pixels per second
+
+// Key dimensions
+const int WHITE_KEY_WIDTH = SCREEN_WIDTH / WHITE_KEYS;
+const int WHITE_KEY_HEIGHT = KEYBOARD_HEIGHT;
+const int BLACK_KEY_WIDTH = WHITE_KEY_WIDTH * 0.6;
+const int BLACK_KEY_HEIGHT = KEYBOARD_HEIGHT * 0.6;
+
+// Colors
+const SDL_Color COLOR_WHITE_KEY = {255, 255, 255, 255};
+const SDL_Color COLOR_BLACK_KEY = {0, 0, 0, 255};
+const SDL_Color COLOR_WHITE_PRESSED = {200, 230, 255, 255};
+const SDL_Color COLOR_BLACK_PRESSED = {100, 100, 150, 255};
+const SDL_Color COLOR_BACKGROUND = {20, 20, 30, 255};
+const SDL_Color COLOR_GUIDE_LINE = {40, 40, 50, 50};
+
+// Piano key structure
+struct PianoKey {
+    int midiNote;
+    bool isBlack;
+    SDL_Rect rect;
+    bool pressed;
+    int whiteKeyIndex;
+};
+
+/**
+ * Key geometry and colors of the waterfall picture.
+ * Shared by the interactive window and the offline renderer so that both
+ * draw exactly the same layout.
+ */
+class PianoLayout {
+public:
+    // All 88 keys in MIDI note order, positioned in screen coordinates
+    static std::vector<PianoKey> createKeys();
+    
+    static bool isBlackKey(int midiNote);
+    static int getWhiteKeyIndex(int midiNote);
+    static SDL_Color getNoteColor(int velocity);
+};
+
+#endif // PIANO_LAYOUT_H
@@ -0,0 +1,65 @@
+#include "PlaybackClock.h"
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+PlaybackClock::PlaybackClock()
+    : anchorTime(0)
+    , anchorSong(0)
+    , speed(1.0)
+    , running(false)
+{
+}
+
+void PlaybackClock::reset() {
+    anchorTime = 0;
+    anchorSong = 0;
+    speed = 1.0;
+    running = false;
+}
+
+void PlaybackClock::seek(int64_t songUs, int64_t now) {
+    anchorTime = now;
+    anchorSong = songUs;
+}
+
+void PlaybackClock::pause(int64_t now) {
+    if (!running) return;
+    
+    anchorSong = getPosition(now);
+    anchorTime = now;
+    running = false;
+}
+
+void PlaybackClock::resume(int64_t now) {
+    if (running) return;
+    
+    // The position was frozen at anchorSong; the new segment starts there
+    anchorTime = now;
+    running = true;
+}
+
+void PlaybackClock::setSpeed(double newSpeed, int64_t now) {
+    anchorSong = getPosition(now);
+    anchorTime = now;
+    speed = newSpeed;
+}
+
+int64_t PlaybackClock::getPosition(int64_t now) const {
+    if (!running || now <= anchorTime) return anchorSong;
+    
+    return anchorSong + static_cast<int64_t>(std::llround((now - anchorTime) * speed));
+}
+
+int64_t PlaybackClock::steadyNow() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t PlaybackClock::audioNow(const AudioClockSample& sample, int sampleRate, int64_t steadyTime) {
+    if (sampleRate <= 0) return 0;
+    
+    int64_t blockUs = static_cast<int64_t>(sample.frames) * 1000000 / sampleRate;
+    int64_t sinceBlock = std::max<int64_t>(0, std::min(steadyTime - sample.stampUs, blockUs));
+    return static_cast<int64_t>(sample.frame * 1000000 / static_cast<uint64_t>(sampleRate)) + sinceBlock;
+}
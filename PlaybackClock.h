@@ -0,0 +1,62 @@
+#ifndef PLAYBACK_CLOCK_H
+#define PLAYBACK_CLOCK_H
+
+#include <cstdint>
+
+// Where the audio device clock stood when the callback began a block
+struct AudioClockSample {
+    uint64_t frame;     // First frame of the block
+    int64_t stampUs;    // Steady clock at the start of the callback
+    int frames;         // Block length
+    
+    AudioClockSample()
+        : frame(0)
+        , stampUs(0)
+        , frames(0)
+    {
+    }
+};
+
+/**
+ * Song position as a piecewise-linear function of a reference clock, in
+ * microseconds. Every pause, resume, seek and speed change starts a new
+ * segment at the position reached so far, so the song never jumps when the
+ * speed changes and paused time is never counted.
+ *
+ * The reference is whatever the caller passes as now: the steady clock
+ * (steadyNow()), or the audio device clock (audioNow()) so that the song
+ * runs at the rate the sound card actually consumes samples and cannot
+ * drift away from the scheduled audio over a long song.
+ */
+class PlaybackClock {
+public:
+    PlaybackClock();
+    
+    // Stopped at the start of the song, at normal speed
+    void reset();
+    
+    void seek(int64_t songUs, int64_t now);
+    void pause(int64_t now);
+    void resume(int64_t now);
+    void setSpeed(double newSpeed, int64_t now);
+    
+    int64_t getPosition(int64_t now) const;
+    double getSpeed() const { return speed; }
+    bool isRunning() const { return running; }
+    
+    // Monotonic system clock in microseconds
+    static int64_t steadyNow();
+    
+    // Audio device time in microseconds: the block being rendered plus the
+    // steady time since its callback, capped at the block's length so the
+    // estimate never runs ahead of the next block
+    static int64_t audioNow(const AudioClockSample& sample, int sampleRate, int64_t steadyTime);
+    
+private:
+    int64_t anchorTime;     // Reference time where the current segment began
+    int64_t anchorSong;     // Song position at anchorTime
+    double speed;
+    bool running;
+};
+
+#endif // PLAYBACK_CLOCK_H
@@ -0,0 +1,188 @@
+#include "Profiler.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+// The calling thread's ring, looked up once per thread
+static thread_local const Profiler* cachedOwner = nullptr;
+static thread_local void* cachedRing = nullptr;
+
+Profiler::Histogram::Histogram()
+    : counts(BUCKETS, 0)
+    , total(0)
+    , maxNs(0)
+{
+}
+
+void Profiler::Histogram::add(uint64_t ns) {
+    double us = ns / 1000.0;
+    int bucket = us < 1.0 ? 0 : static_cast<int>(std::log2(us) * 16.0) + 1;
+    counts[std::min(bucket, BUCKETS - 1)]++;
+    total++;
+    maxNs = std::max(maxNs, ns);
+}
+
+double Profiler::Histogram::getPercentileMs(double fraction) const {
+    if (total == 0) return 0.0;
+    
+    // Report the upper edge of the bucket holding the percentile, but
+    // never more than the largest duration seen
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * total));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            double upperUs = std::exp2(bucket / 16.0);
+            return std::min(upperUs / 1000.0, maxNs / 1e6);
+        }
+    }
+    return maxNs / 1e6;
+}
+
+Profiler::Profiler()
+    : enabled(false)
+    , tracing(false)
+    , frameNext(0)
+    , frameCount(0)
+    , droppedTraceSamples(0)
+{
+}
+
+Profiler& Profiler::shared() {
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::ThreadRing& Profiler::getThreadRing() {
+    if (cachedOwner == this) {
+        return *static_cast<ThreadRing*>(cachedRing);
+    }
+    
+    // First sample of this thread: register a ring for it
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    int id = static_cast<int>(rings.size()) + 1;
+    rings.emplace_back(new ThreadRing(id, "thread " + std::to_string(id)));
+    cachedOwner = this;
+    cachedRing = rings.back().get();
+    return *rings.back();
+}
+
+void Profiler::setThreadName(const char* name) {
+    ThreadRing& ring = getThreadRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    ring.name = name;
+}
+
+void Profiler::record(const char* name, uint64_t beginNs, uint64_t endNs) {
+    ProfileSample sample;
+    sample.name = name;
+    sample.beginNs = beginNs;
+    sample.endNs = endNs;
+    getThreadRing().samples.push(sample);
+}
+
+void Profiler::collect() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    
+    for (auto& ring : rings) {
+        SpscQueue<ProfileSample>& samples = ring->samples;
+        while (!samples.empty()) {
+            ProfileSample sample = samples.front();
+            samples.pop();
+            
+            uint64_t duration = sample.endNs - sample.beginNs;
+            // Only a section's first sample inserts (and allocates)
+            auto histogram = histograms.find(sample.name);
+            if (histogram == histograms.end()) {
+                histogram = histograms.emplace(sample.name, Histogram()).first;
+            }
+            histogram->second.add(duration);
+            
+            if (std::strcmp(sample.name, "frame") == 0) {
+                frameHistory[frameNext] = duration / 1e6f;
+                frameNext = (frameNext + 1) % FRAME_HISTORY;
+                if (frameCount < FRAME_HISTORY) frameCount++;
+            }
+            
+            if (tracing) {
+                if (trace.size() < MAX_TRACE_SAMPLES) {
+                    trace.push_back({sample, ring->id});
+                } else {
+                    droppedTraceSamples++;
+                }
+            }
+        }
+    }
+}
+
+bool Profiler::writeTrace(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to write trace: " << path << std::endl;
+        return false;
+    }
+    
+    // Complete ("X") events in microseconds, relative to the first sample
+    uint64_t origin = UINT64_MAX;
+    for (const auto& event : trace) {
+        origin = std::min(origin, event.sample.beginNs);
+    }
+    
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& ring : rings) {
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->id
+             << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+        first = false;
+    }
+    file << std::fixed << std::setprecision(3);
+    for (const auto& event : trace) {
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"" << event.sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << (event.sample.beginNs - origin) / 1000.0
+             << ",\"dur\":" << (event.sample.endNs - event.sample.beginNs) / 1000.0 << "}";
+        first = false;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    
+    std::cout << "Wrote " << trace.size() << " trace events to " << path;
+    if (droppedTraceSamples > 0) {
+        std::cout << " (" << droppedTraceSamples << " more were not kept)";
+    }
+    std::cout << std::endl;
+    return static_cast<bool>(file);
+}
+
+void Profiler::printStats(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    out << "Timing per section (ms):" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const auto& entry : histograms) {
+        const Histogram& histogram = entry.second;
+        out << "  " << std::left << std::setw(18) << entry.first << std::right
+            << " n=" << std::setw(8) << histogram.total
+            << "  p50 " << std::setw(8) << histogram.getPercentileMs(0.50)
+            << "  p99 " << std::setw(8) << histogram.getPercentileMs(0.99)
+            << "  max " << std::setw(8) << histogram.maxNs / 1e6 << std::endl;
+    }
+    
+    uint64_t dropped = 0;
+    for (const auto& ring : rings) {
+        dropped += ring->samples.getDroppedCount();
+    }
+    if (dropped > 0) {
+        out << "  (" << dropped << " samples dropped by full rings)" << std::endl;
+    }
+    out << std::defaultfloat;
+}
@@ -0,0 +1,151 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+#include "SpscQueue.h"
+
+// One timed section: name must be a string literal (or otherwise outlive
+// the profiler); times are steady-clock nanoseconds
+struct ProfileSample {
+    const char* name;
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+/**
+ * Scoped-timer instrumentation for the hot paths.
+ * Every thread records into its own lock-free ring, so timing a section
+ * costs two clock reads and a push, and nothing at all while the profiler
+ * is disabled. One consumer thread (the UI thread) drains the rings with
+ * collect() once per frame and keeps:
+ * - a duration histogram per section, for p50/p99/max at exit;
+ * - the recent frame times, for the on-screen graph;
+ * - optionally every sample, for a Chrome trace-event JSON file
+ *   (chrome://tracing or https://ui.perfetto.dev).
+ * A ring that fills up between two collections drops samples and counts them.
+ */
+class Profiler {
+public:
+    static const size_t RING_CAPACITY = 16 * 1024;
+    static const size_t FRAME_HISTORY = 240;            // Frames shown in the graph
+    static const size_t MAX_TRACE_SAMPLES = 4 * 1024 * 1024;
+    
+    Profiler();
+    
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    
+    // Process-wide profiler, created on first use
+    static Profiler& shared();
+    
+    void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    
+    // Keep every sample for writeTrace()
+    void setTracing(bool trace) { tracing = trace; }
+    
+    // Name the calling thread in the trace
+    void setThreadName(const char* name);
+    
+    // Record a finished section on the calling thread's ring
+    void record(const char* name, uint64_t beginNs, uint64_t endNs);
+    
+    // Consumer side: drain every ring into the statistics
+    void collect();
+    
+    // Durations (ms) of the last FRAME_HISTORY "frame" sections; index 0 is the oldest
+    size_t getFrameCount() const { return frameCount; }
+    float getFrameTime(size_t index) const {
+        return frameHistory[(frameNext + FRAME_HISTORY - frameCount + index) % FRAME_HISTORY];
+    }
+    
+    bool writeTrace(const std::string& path) const;
+    void printStats(std::ostream& out) const;
+    
+    static uint64_t now();
+    
+private:
+    struct ThreadRing {
+        SpscQueue<ProfileSample> samples;
+        std::string name;
+        int id;
+        
+        ThreadRing(int id, const std::string& name)
+            : samples(RING_CAPACITY)
+            , name(name)
+            , id(id)
+        {
+        }
+    };
+    
+    // Durations in logarithmic buckets (16 per octave of microseconds),
+    // so the percentiles are within about 5% whatever the run length
+    struct Histogram {
+        static const int BUCKETS = 16 * 32;
+        
+        std::vector<uint64_t> counts;
+        uint64_t total;
+        uint64_t maxNs;
+        
+        Histogram();
+        void add(uint64_t ns);
+        double getPercentileMs(double fraction) const;
+    };
+    
+    struct TraceSample {
+        ProfileSample sample;
+        int thread;
+    };
+    
+    std::atomic<bool> enabled;
+    bool tracing;
+    
+    mutable std::mutex ringsMutex;  // Guards the list, not the rings themselves
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+    
+    // Consumer state
+    // Looked up by the samples' C strings without building a std::string
+    std::map<std::string, Histogram, std::less<>> histograms;
+    float frameHistory[FRAME_HISTORY];  // Ring of frame durations
+    size_t frameNext;                   // Slot of the next frame
+    size_t frameCount;
+    std::vector<TraceSample> trace;
+    uint64_t droppedTraceSamples;
+    
+    ThreadRing& getThreadRing();
+};
+
+/**
+ * Times the enclosing block under the given name:
+ *     ProfileScope scope("renderWaterfall");
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name)
+        : name(name)
+        , beginNs(Profiler::shared().isEnabled() ? Profiler::now() : 0)
+    {
+    }
+    
+    ~ProfileScope() {
+        if (beginNs != 0) {
+            Profiler::shared().record(name, beginNs, Profiler::now());
+        }
+    }
+    
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+    
+private:
+    const char* name;
+    uint64_t beginNs;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,175 @@
+#include "RenderBatch.h"
+#include <algorithm>
+
+static bool sameColor(SDL_Color a, SDL_Color b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+RenderBatch::RenderBatch()
+    : peakRects(0)
+    , peakLayers(0)
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    , useGeometry(true)
+#else
+    , useGeometry(false)
+#endif
+{
+    layerStarts.push_back(0);
+}
+
+void RenderBatch::begin(Arena& frameArena) {
+    rects = ArenaVector<SDL_Rect>(ArenaAllocator<SDL_Rect>(&frameArena));
+    colors = ArenaVector<SDL_Color>(ArenaAllocator<SDL_Color>(&frameArena));
+    layerStarts = ArenaVector<size_t>(ArenaAllocator<size_t>(&frameArena));
+    vertices = ArenaVector<SDL_Vertex>(ArenaAllocator<SDL_Vertex>(&frameArena));
+    indices = ArenaVector<int>(ArenaAllocator<int>(&frameArena));
+    bucket = ArenaVector<SDL_Rect>(ArenaAllocator<SDL_Rect>(&frameArena));
+    layerColors = ArenaVector<SDL_Color>(ArenaAllocator<SDL_Color>(&frameArena));
+    
+    // Reserving the peak up front means nothing grows (and leaves its old
+    // copy behind in the arena) during the frame
+    rects.reserve(peakRects);
+    colors.reserve(peakRects);
+    layerStarts.reserve(peakLayers + 1);
+    if (useGeometry) {
+        vertices.reserve(peakRects * 4);
+        indices.reserve(peakRects * 6);
+    } else {
+        bucket.reserve(peakRects);
+        layerColors.reserve(16);
+    }
+    layerStarts.push_back(0);
+}
+
+void RenderBatch::clear() {
+    rects.clear();
+    colors.clear();
+    layerStarts.assign(1, 0);
+}
+
+void RenderBatch::addRect(const SDL_Rect& rect, SDL_Color color) {
+    if (rect.w <= 0 || rect.h <= 0) return;
+    rects.push_back(rect);
+    colors.push_back(color);
+}
+
+void RenderBatch::addOutline(const SDL_Rect& rect, SDL_Color color) {
+    addRect({rect.x, rect.y, rect.w, 1}, color);
+    if (rect.h > 1) {
+        addRect({rect.x, rect.y + rect.h - 1, rect.w, 1}, color);
+    }
+    addRect({rect.x, rect.y + 1, 1, rect.h - 2}, color);
+    if (rect.w > 1) {
+        addRect({rect.x + rect.w - 1, rect.y + 1, 1, rect.h - 2}, color);
+    }
+}
+
+void RenderBatch::nextLayer() {
+    if (layerStarts.back() != rects.size()) {
+        layerStarts.push_back(rects.size());
+    }
+}
+
+int RenderBatch::flush(SDL_Renderer* renderer) {
+    if (rects.empty()) {
+        clear();
+        return 0;
+    }
+    peakRects = std::max(peakRects, rects.size());
+    peakLayers = std::max(peakLayers, layerStarts.size());
+    
+    int drawCalls = 0;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (useGeometry) {
+        drawCalls = flushGeometry(renderer);
+        
+        // Some render drivers do not implement geometry; stop trying
+        if (drawCalls < 0) {
+            useGeometry = false;
+            drawCalls = 0;
+        }
+    }
+#endif
+    if (!useGeometry) {
+        drawCalls = flushFillRects(renderer);
+    }
+    
+    clear();
+    return drawCalls;
+}
+
+int RenderBatch::flushGeometry(SDL_Renderer* renderer) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    // Two triangles per rectangle, in submission order
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(rects.size() * 4);
+    indices.reserve(rects.size() * 6);
+    
+    for (size_t i = 0; i < rects.size(); i++) {
+        const SDL_Rect& rect = rects[i];
+        float left = static_cast<float>(rect.x);
+        float top = static_cast<float>(rect.y);
+        float right = static_cast<float>(rect.x + rect.w);
+        float bottom = static_cast<float>(rect.y + rect.h);
+        
+        int base = static_cast<int>(vertices.size());
+        vertices.push_back({{left, top}, colors[i], {0.0f, 0.0f}});
+        vertices.push_back({{right, top}, colors[i], {0.0f, 0.0f}});
+        vertices.push_back({{right, bottom}, colors[i], {0.0f, 0.0f}});
+        vertices.push_back({{left, bottom}, colors[i], {0.0f, 0.0f}});
+        
+        indices.push_back(base);
+        indices.push_back(base + 1);
+        indices.push_back(base + 2);
+        indices.push_back(base);
+        indices.push_back(base + 2);
+        indices.push_back(base + 3);
+    }
+    
+    if (SDL_RenderGeometry(renderer, nullptr, vertices.data(), static_cast<int>(vertices.size()),
+                           indices.data(), static_cast<int>(indices.size())) < 0) {
+        return -1;
+    }
+    return 1;
+#else
+    (void)renderer;
+    return -1;
+#endif
+}
+
+int RenderBatch::flushFillRects(SDL_Renderer* renderer) {
+    int drawCalls = 0;
+    
+    for (size_t layer = 0; layer < layerStarts.size(); layer++) {
+        size_t begin = layerStarts[layer];
+        size_t end = layer + 1 < layerStarts.size() ? layerStarts[layer + 1] : rects.size();
+        
+        // Layers use only a handful of colors, so a linear scan is enough
+        layerColors.clear();
+        for (size_t i = begin; i < end; i++) {
+            bool known = false;
+            for (const auto& color : layerColors) {
+                known = known || sameColor(color, colors[i]);
+            }
+            if (!known) {
+                layerColors.push_back(colors[i]);
+            }
+        }
+        
+        for (const auto& color : layerColors) {
+            bucket.clear();
+            for (size_t i = begin; i < end; i++) {
+                if (sameColor(colors[i], color)) {
+                    bucket.push_back(rects[i]);
+                }
+            }
+            
+            SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+            SDL_RenderFillRects(renderer, bucket.data(), static_cast<int>(bucket.size()));
+            drawCalls++;
+        }
+    }
+    
+    return drawCalls;
+}
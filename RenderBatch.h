@@ -0,0 +1,60 @@
+#ifndef RENDER_BATCH_H
+#define RENDER_BATCH_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cstddef>
+#include "Arena.h"
+
+/**
+ * Collects the solid rectangles of a frame and submits them together.
+ * On SDL 2.0.18 and newer the whole batch becomes one SDL_RenderGeometry
+ * call. Otherwise (or if the renderer rejects geometry) each layer is
+ * drawn with one SDL_RenderFillRects call per color, which only reorders
+ * rectangles inside a layer, never across layers.
+ *
+ * All arrays are carved from the frame arena passed to begin(), sized for
+ * the largest batch seen so far; until the first begin() they use the heap.
+ */
+class RenderBatch {
+public:
+    RenderBatch();
+    
+    // Start a frame. The batch must be empty, and the arena must have been
+    // rewound and stay untouched by others until the next begin()
+    void begin(Arena& frameArena);
+    
+    void clear();
+    void addRect(const SDL_Rect& rect, SDL_Color color);
+    // One-pixel border, drawn like SDL_RenderDrawRect
+    void addOutline(const SDL_Rect& rect, SDL_Color color);
+    // Everything added after this is drawn over everything added before
+    void nextLayer();
+    
+    // Submit and clear the batch; returns the number of draw calls issued
+    int flush(SDL_Renderer* renderer);
+    
+    size_t getRectCount() const { return rects.size(); }
+    
+private:
+    ArenaVector<SDL_Rect> rects;
+    ArenaVector<SDL_Color> colors;
+    ArenaVector<size_t> layerStarts;
+    
+    // Scratch buffers for flushing
+    ArenaVector<SDL_Vertex> vertices;
+    ArenaVector<int> indices;
+    ArenaVector<SDL_Rect> bucket;
+    ArenaVector<SDL_Color> layerColors;
+    
+    // Largest batch flushed so far
+    size_t peakRects;
+    size_t peakLayers;
+    
+    bool useGeometry;
+    
+    int flushGeometry(SDL_Renderer* renderer);
+    int flushFillRects(SDL_Renderer* renderer);
+};
+
+#endif // RENDER_BATCH_H
@@ -0,0 +1,61 @@
+#include "SeekIndex.h"
+#include <algorithm>
+
+// Same rule as playback: the last event on a key decides whether it is
+// held, even when several notes on it overlap
+static void applyEvent(KeyVelocities& keys, const MidiEvent& event) {
+    keys[event.note & 127] = event.isNoteOn ? event.velocity : 0;
+}
+
+void SeekIndex::clear() {
+    std::vector<uint32_t>().swap(times);
+    std::vector<KeyVelocities>().swap(keyframes);
+}
+
+void SeekIndex::build(const NoteTimeline& timeline, uint32_t intervalMs) {
+    clear();
+    intervalMs = std::max<uint32_t>(1, intervalMs);
+    
+    EventScheduler scheduler;
+    scheduler.reset(&timeline);
+    KeyVelocities keys;
+    keys.fill(0);
+    times.push_back(0);
+    keyframes.push_back(keys);
+    
+    // Step one millisecond at a time; a keyframe at time t holds the keys
+    // after every event up to t - 1
+    size_t events = 0;
+    uint32_t duration = timeline.getDuration();
+    for (uint32_t t = 1; t <= duration; t++) {
+        events += scheduler.advance(t - 1, [&](const MidiEvent& event) {
+            applyEvent(keys, event);
+        });
+        if (t - times.back() >= intervalMs || events >= MAX_EVENTS_PER_KEYFRAME) {
+            times.push_back(t);
+            keyframes.push_back(keys);
+            events = 0;
+        }
+    }
+}
+
+void SeekIndex::seek(EventScheduler& scheduler, uint32_t time, KeyVelocities& keys) const {
+    if (keyframes.empty()) {
+        keys.fill(0);
+        scheduler.seek(time);
+        return;
+    }
+    
+    // Last keyframe at or before the target
+    size_t index = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+    keys = keyframes[index];
+    
+    // Replaying [keyframe, time) leaves the cursors where seek(time) would
+    // put them
+    scheduler.seek(times[index]);
+    if (time > times[index]) {
+        scheduler.advance(time - 1, [&](const MidiEvent& event) {
+            applyEvent(keys, event);
+        });
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include "NoteTimeline.h"
+#include "EventScheduler.h"
+
+// Velocity of every held key by MIDI note, 0 when released
+typedef std::array<uint8_t, 128> KeyVelocities;
+
+/**
+ * Keyframes of the held keys along a loaded song, so a seek does not have
+ * to replay the song from the start to know which keys are down.
+ * A keyframe holds the keys exactly as playback leaves them after
+ * dispatching every event before its time. One is stored every interval,
+ * and sooner where the song is so dense that MAX_EVENTS_PER_KEYFRAME
+ * events pass first. A seek restores the keyframe at or before the target
+ * and replays only the events between the two, so its cost depends on
+ * that event count (or one millisecond's worth, if more) and not on the
+ * length of the song.
+ */
+class SeekIndex {
+public:
+    static const uint32_t DEFAULT_INTERVAL_MS = 1000;
+    static const size_t MAX_EVENTS_PER_KEYFRAME = 2048;
+    
+    // One pass over the timeline's events and milliseconds
+    void build(const NoteTimeline& timeline, uint32_t intervalMs = DEFAULT_INTERVAL_MS);
+    void clear();
+    
+    // Position a scheduler attached to the indexed timeline so that the
+    // next event it dispatches is the first one at or after time, like
+    // EventScheduler::seek(), and return the keys held just before it
+    void seek(EventScheduler& scheduler, uint32_t time, KeyVelocities& keys) const;
+    
+    bool empty() const { return keyframes.empty(); }
+    size_t getKeyframeCount() const { return keyframes.size(); }
+    
+private:
+    std::vector<uint32_t> times;            // Ascending; the first is 0
+    std::vector<KeyVelocities> keyframes;
+};
+
+#endif // SEEK_INDEX_H
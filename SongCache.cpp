@@ -0,0 +1,267 @@
+#include "SongCache.h"
+#include "NoteTimeline.h"
+#include "MidiParser.h"
+#include "MappedFile.h"
+#include "ByteCursor.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+static const char CACHE_MAGIC[4] = {'W', 'F', 'P', 'C'};
+static const size_t HEADER_SIZE = 64;
+
+// Header field offsets
+static const size_t OFFSET_VERSION = 4;
+static const size_t OFFSET_SOURCE_SIZE = 8;
+static const size_t OFFSET_SOURCE_HASH = 16;
+static const size_t OFFSET_NOTE_COUNT = 24;
+static const size_t OFFSET_START_BYTES = 32;
+static const size_t OFFSET_DURATION_BYTES = 40;
+static const size_t OFFSET_PAYLOAD_HASH = 48;
+static const size_t OFFSET_SONG_DURATION = 56;
+static const size_t OFFSET_OVERLAP_POLICY = 60;
+
+// Fixed-size columns: key and velocity (2 bytes), track (2), channel (1)
+static const size_t BYTES_PER_NOTE = 5;
+
+// All integers are stored little-endian
+static void writeLE(uint8_t* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+static uint64_t readLE(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+static void appendVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool readVarint(ByteCursor& cursor, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!cursor.readByte(byte)) return false;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+std::string SongCache::getCachePath(const std::string& midiFile) {
+    return midiFile + ".wfcache";
+}
+
+uint64_t SongCache::hashBytes(const uint8_t* data, size_t size) {
+    // FNV-style multiply/xor over 64-bit words; fast enough to hash a
+    // multi-hundred-MB file in well under the time it takes to parse it
+    const uint64_t prime = 0x100000001B3ULL;
+    uint64_t hash = 0xCBF29CE484222325ULL ^ size;
+    
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    
+    return hash ^ (hash >> 32);
+}
+
+bool SongCache::save(const std::string& midiFile, const NoteTimeline& timeline,
+                     NotePairing::Policy policy) {
+    MappedFile source;
+    if (!source.open(midiFile)) {
+        return false;
+    }
+    
+    const auto& noteStarts = timeline.getStarts();
+    const auto& noteDurations = timeline.getDurations();
+    const auto& keys = timeline.getKeys();
+    const auto& velocities = timeline.getVelocities();
+    const auto& channels = timeline.getChannels();
+    const auto& tracks = timeline.getTracks();
+    const size_t count = timeline.size();
+    
+    // Struct-of-arrays payload, column by column like the timeline
+    std::vector<uint8_t> starts;
+    std::vector<uint8_t> durations;
+    starts.reserve(count * 2);
+    durations.reserve(count * 2);
+    
+    uint32_t previousStart = 0;
+    for (size_t i = 0; i < count; i++) {
+        appendVarint(starts, noteStarts[i] - previousStart);
+        appendVarint(durations, noteDurations[i]);
+        previousStart = noteStarts[i];
+    }
+    
+    std::vector<uint8_t> file(HEADER_SIZE + starts.size() + durations.size() + count * BYTES_PER_NOTE);
+    uint8_t* out = file.data() + HEADER_SIZE;
+    std::memcpy(out, starts.data(), starts.size());
+    out += starts.size();
+    std::memcpy(out, durations.data(), durations.size());
+    out += durations.size();
+    
+    for (size_t i = 0; i < count; i++) {
+        writeLE(out, (keys[i] & 0x7F) | ((velocities[i] & 0x7F) << 7), 2);
+        out += 2;
+    }
+    for (size_t i = 0; i < count; i++) {
+        writeLE(out, tracks[i], 2);
+        out += 2;
+    }
+    std::memcpy(out, channels.data(), count);
+    
+    uint8_t* header = file.data();
+    std::memcpy(header, CACHE_MAGIC, 4);
+    writeLE(header + OFFSET_VERSION, VERSION, 4);
+    writeLE(header + OFFSET_SOURCE_SIZE, source.size(), 8);
+    writeLE(header + OFFSET_SOURCE_HASH, hashBytes(source.data(), source.size()), 8);
+    writeLE(header + OFFSET_NOTE_COUNT, count, 8);
+    writeLE(header + OFFSET_START_BYTES, starts.size(), 8);
+    writeLE(header + OFFSET_DURATION_BYTES, durations.size(), 8);
+    writeLE(header + OFFSET_PAYLOAD_HASH, hashBytes(file.data() + HEADER_SIZE, file.size() - HEADER_SIZE), 8);
+    writeLE(header + OFFSET_SONG_DURATION, timeline.getDuration(), 4);
+    writeLE(header + OFFSET_OVERLAP_POLICY, policy, 4);
+    
+    // Write to a temporary file first so a crash never leaves a torn cache
+    std::string path = getCachePath(midiFile);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+        if (!stream.write(reinterpret_cast<const char*>(file.data()), file.size())) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+bool SongCache::load(const std::string& midiFile, NoteTimeline& timeline,
+                     NotePairing::Policy policy) {
+    MappedFile cache;
+    if (!cache.open(getCachePath(midiFile))) {
+        return false;
+    }
+    
+    const uint8_t* data = cache.data();
+    const size_t size = cache.size();
+    
+    if (size < HEADER_SIZE || std::memcmp(data, CACHE_MAGIC, 4) != 0) {
+        std::cerr << "Ignoring invalid song cache" << std::endl;
+        return false;
+    }
+    if (readLE(data + OFFSET_VERSION, 4) != VERSION ||
+        readLE(data + OFFSET_OVERLAP_POLICY, 4) != static_cast<uint64_t>(policy)) {
+        return false;
+    }
+    
+    // The cache is only valid for the exact source file it was built from
+    MappedFile source;
+    if (!source.open(midiFile) || readLE(data + OFFSET_SOURCE_SIZE, 8) != source.size() ||
+        readLE(data + OFFSET_SOURCE_HASH, 8) != hashBytes(source.data(), source.size())) {
+        return false;
+    }
+    
+    uint64_t count = readLE(data + OFFSET_NOTE_COUNT, 8);
+    uint64_t startBytes = readLE(data + OFFSET_START_BYTES, 8);
+    uint64_t durationBytes = readLE(data + OFFSET_DURATION_BYTES, 8);
+    uint64_t payloadSize = size - HEADER_SIZE;
+    
+    // Array sizes must add up to exactly the payload
+    if (count > payloadSize / BYTES_PER_NOTE || startBytes > payloadSize || durationBytes > payloadSize ||
+        startBytes + durationBytes + count * BYTES_PER_NOTE != payloadSize) {
+        std::cerr << "Ignoring corrupt song cache" << std::endl;
+        return false;
+    }
+    if (readLE(data + OFFSET_PAYLOAD_HASH, 8) != hashBytes(data + HEADER_SIZE, payloadSize)) {
+        std::cerr << "Ignoring corrupt song cache" << std::endl;
+        return false;
+    }
+    
+    size_t startOffset = HEADER_SIZE;
+    size_t durationOffset = startOffset + startBytes;
+    size_t keyOffset = durationOffset + durationBytes;
+    size_t trackOffset = keyOffset + count * 2;
+    size_t channelOffset = trackOffset + count * 2;
+    
+    ByteCursor starts(data, startOffset, durationOffset);
+    ByteCursor durations(data, durationOffset, keyOffset);
+    
+    timeline.clear();
+    timeline.reserve(static_cast<size_t>(count));
+    uint32_t start = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t delta, duration;
+        if (!readVarint(starts, delta) || !readVarint(durations, duration)) {
+            std::cerr << "Ignoring corrupt song cache" << std::endl;
+            timeline.clear();
+            return false;
+        }
+        
+        uint16_t keyVelocity = static_cast<uint16_t>(readLE(data + keyOffset + i * 2, 2));
+        
+        // Start deltas are never negative, so the notes arrive in start order
+        start += delta;
+        timeline.add(start, duration, keyVelocity & 0x7F, (keyVelocity >> 7) & 0x7F,
+                     data[channelOffset + i] & 0x0F,
+                     static_cast<uint16_t>(readLE(data + trackOffset + i * 2, 2)));
+    }
+    
+    timeline.finish();
+    
+    // The notes must end where the song did when the cache was written
+    if (readLE(data + OFFSET_SONG_DURATION, 4) != timeline.getDuration()) {
+        std::cerr << "Ignoring corrupt song cache" << std::endl;
+        timeline.clear();
+        return false;
+    }
+    return true;
+}
+
+bool SongCache::loadTimeline(const std::string& midiFile, NoteTimeline& timeline,
+                             NotePairing::Policy policy) {
+    // A valid cache skips parsing entirely
+    if (load(midiFile, timeline, policy)) {
+        std::cout << "Loaded song cache: " << getCachePath(midiFile) << std::endl;
+        return true;
+    }
+    
+    MidiParser parser;
+    parser.setOverlapPolicy(policy);
+    if (!parser.loadFile(midiFile)) {
+        std::cerr << "Failed to load MIDI file: " << midiFile << std::endl;
+        return false;
+    }
+    
+    timeline.build(parser);
+    
+    if (save(midiFile, timeline, policy)) {
+        std::cout << "Wrote song cache: " << getCachePath(midiFile) << std::endl;
+    }
+    return true;
+}
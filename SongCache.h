@@ -0,0 +1,43 @@
+#ifndef SONG_CACHE_H
+#define SONG_CACHE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "NotePairing.h"
+
+class NoteTimeline;
+
+/**
+ * Binary sidecar cache of a parsed song ("song.mid" -> "song.mid.wfcache").
+ *
+ * The file holds the notes column by column, like the timeline does:
+ * variable-length start deltas and durations, key and velocity packed into
+ * 7 bits each, a track ID and a channel. The header records a format version, the
+ * size and hash of the source .mid file, the overlap policy the notes were
+ * paired with, the song duration and a hash of the payload, and everything
+ * is validated before the notes are used.
+ */
+class SongCache {
+public:
+    static const uint32_t VERSION = 3;
+    
+    static std::string getCachePath(const std::string& midiFile);
+    
+    // Load the cached notes of midiFile; false if missing, stale, invalid
+    // or paired with another policy
+    static bool load(const std::string& midiFile, NoteTimeline& timeline,
+                     NotePairing::Policy policy = NotePairing::FIRST_IN_FIRST_OUT);
+    
+    // Write the cache next to midiFile; failures are not fatal
+    static bool save(const std::string& midiFile, const NoteTimeline& timeline,
+                     NotePairing::Policy policy = NotePairing::FIRST_IN_FIRST_OUT);
+    
+    // Fill the timeline from the cache, or parse midiFile and cache the result
+    static bool loadTimeline(const std::string& midiFile, NoteTimeline& timeline,
+                             NotePairing::Policy policy = NotePairing::FIRST_IN_FIRST_OUT);
+    
+    static uint64_t hashBytes(const uint8_t* data, size_t size);
+};
+
+#endif // SONG_CACHE_H
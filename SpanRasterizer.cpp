@@ -0,0 +1,214 @@
+#include "SpanRasterizer.h"
+#include "CpuFeatures.h"
+#include <cstring>
+
+static void blendRectScalar(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                            SDL_Color color) {
+    for (size_t y = 0; y < height; y++, pixels += stride) {
+        SpanRasterizer::blendScalar(pixels, width, color);
+    }
+}
+
+void SpanRasterizer::blendScalar(uint8_t* pixels, size_t count, SDL_Color color) {
+    // dst = (src * a + dst * (255 - a) + 127) / 255 for every channel,
+    // where the source alpha channel counts as 255
+    unsigned alpha = color.a;
+    unsigned inverse = 255 - alpha;
+    unsigned r = color.r * alpha + 127;
+    unsigned g = color.g * alpha + 127;
+    unsigned b = color.b * alpha + 127;
+    unsigned a = 255 * alpha + 127;
+    
+    for (size_t i = 0; i < count; i++, pixels += 4) {
+        pixels[0] = static_cast<uint8_t>((r + pixels[0] * inverse) / 255);
+        pixels[1] = static_cast<uint8_t>((g + pixels[1] * inverse) / 255);
+        pixels[2] = static_cast<uint8_t>((b + pixels[2] * inverse) / 255);
+        pixels[3] = static_cast<uint8_t>((a + pixels[3] * inverse) / 255);
+    }
+}
+
+void SpanRasterizer::fillRect(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                              SDL_Color color) {
+    uint8_t bytes[4] = {color.r, color.g, color.b, color.a};
+    uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    
+    for (size_t y = 0; y < height; y++, pixels += stride) {
+        for (size_t i = 0; i < width; i++) {
+            std::memcpy(pixels + i * 4, &value, 4);
+        }
+    }
+}
+
+#ifdef CPU_FEATURES_X86
+
+// Blending works on 16-bit lanes: the largest intermediate value is
+// 255 * 255 + 127, and for every such x, x / 255 == (x + 1 + (x >> 8)) >> 8
+
+CPU_TARGET("sse2")
+static inline __m128i blend4(__m128i dst, __m128i source, __m128i inverse) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    
+    __m128i lo = _mm_unpacklo_epi8(dst, zero);
+    __m128i hi = _mm_unpackhi_epi8(dst, zero);
+    lo = _mm_add_epi16(_mm_mullo_epi16(lo, inverse), source);
+    hi = _mm_add_epi16(_mm_mullo_epi16(hi, inverse), source);
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+CPU_TARGET("sse2")
+static void blendRectSSE2(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                          SDL_Color color) {
+    unsigned alpha = color.a;
+    short r = static_cast<short>(color.r * alpha + 127);
+    short g = static_cast<short>(color.g * alpha + 127);
+    short b = static_cast<short>(color.b * alpha + 127);
+    short a = static_cast<short>(255 * alpha + 127);
+    
+    const __m128i inverse = _mm_set1_epi16(static_cast<short>(255 - alpha));
+    const __m128i source = _mm_setr_epi16(r, g, b, a, r, g, b, a);
+    
+    for (size_t y = 0; y < height; y++, pixels += stride) {
+        // Four pixels per iteration
+        size_t i = 0;
+        for (; i + 4 <= width; i += 4) {
+            __m128i* address = reinterpret_cast<__m128i*>(pixels + i * 4);
+            _mm_storeu_si128(address, blend4(_mm_loadu_si128(address), source, inverse));
+        }
+        
+        // The last one to three pixels go through a small buffer
+        if (i < width) {
+            size_t bytes = (width - i) * 4;
+            alignas(16) uint8_t tail[16] = {};
+            std::memcpy(tail, pixels + i * 4, bytes);
+            __m128i* address = reinterpret_cast<__m128i*>(tail);
+            _mm_store_si128(address, blend4(_mm_load_si128(address), source, inverse));
+            std::memcpy(pixels + i * 4, tail, bytes);
+        }
+    }
+}
+
+CPU_TARGET("avx2")
+static inline __m256i blend8(__m256i dst, __m256i source, __m256i inverse) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    
+    // Unpacking and packing both work within 128-bit lanes, so the pixel
+    // order is preserved
+    __m256i lo = _mm256_unpacklo_epi8(dst, zero);
+    __m256i hi = _mm256_unpackhi_epi8(dst, zero);
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, inverse), source);
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, inverse), source);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one), _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one), _mm256_srli_epi16(hi, 8)), 8);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+CPU_TARGET("avx2")
+static void blendRectAVX2(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                          SDL_Color color) {
+    unsigned alpha = color.a;
+    short r = static_cast<short>(color.r * alpha + 127);
+    short g = static_cast<short>(color.g * alpha + 127);
+    short b = static_cast<short>(color.b * alpha + 127);
+    short a = static_cast<short>(255 * alpha + 127);
+    
+    const __m256i inverse = _mm256_set1_epi16(static_cast<short>(255 - alpha));
+    const __m256i source = _mm256_setr_epi16(r, g, b, a, r, g, b, a,
+                                             r, g, b, a, r, g, b, a);
+    
+    for (size_t y = 0; y < height; y++, pixels += stride) {
+        // Eight pixels per iteration
+        size_t i = 0;
+        for (; i + 8 <= width; i += 8) {
+            __m256i* address = reinterpret_cast<__m256i*>(pixels + i * 4);
+            _mm256_storeu_si256(address, blend8(_mm256_loadu_si256(address), source, inverse));
+        }
+        
+        // The last one to seven pixels go through a small buffer
+        if (i < width) {
+            size_t bytes = (width - i) * 4;
+            alignas(32) uint8_t tail[32] = {};
+            std::memcpy(tail, pixels + i * 4, bytes);
+            __m256i* address = reinterpret_cast<__m256i*>(tail);
+            _mm256_store_si256(address, blend8(_mm256_load_si256(address), source, inverse));
+            std::memcpy(pixels + i * 4, tail, bytes);
+        }
+    }
+    
+    // Avoid AVX to SSE transition stalls in the caller
+    _mm256_zeroupper();
+}
+
+#endif // CPU_FEATURES_X86
+
+typedef void (*BlendKernel)(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                            SDL_Color color);
+
+struct KernelChoice {
+    SpanRasterizer::Kernel kernel;
+    BlendKernel blend;
+    const char* name;
+};
+
+static BlendKernel getBlendKernel(SpanRasterizer::Kernel kernel) {
+#ifdef CPU_FEATURES_X86
+    if (kernel == SpanRasterizer::KERNEL_AVX2) return blendRectAVX2;
+    if (kernel == SpanRasterizer::KERNEL_SSE2) return blendRectSSE2;
+#else
+    (void)kernel;
+#endif
+    return blendRectScalar;
+}
+
+static KernelChoice makeChoice(SpanRasterizer::Kernel kernel, const char* name) {
+    return {kernel, getBlendKernel(kernel), name};
+}
+
+static KernelChoice selectKernel() {
+    if (SpanRasterizer::isKernelSupported(SpanRasterizer::KERNEL_AVX2)) {
+        return makeChoice(SpanRasterizer::KERNEL_AVX2, "AVX2");
+    }
+    if (SpanRasterizer::isKernelSupported(SpanRasterizer::KERNEL_SSE2)) {
+        return makeChoice(SpanRasterizer::KERNEL_SSE2, "SSE2");
+    }
+    return makeChoice(SpanRasterizer::KERNEL_SCALAR, "scalar");
+}
+
+// Chosen once, on first use
+static const KernelChoice& getKernel() {
+    static const KernelChoice choice = selectKernel();
+    return choice;
+}
+
+void SpanRasterizer::blendRect(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                               SDL_Color color) {
+    getKernel().blend(pixels, stride, width, height, color);
+}
+
+void SpanRasterizer::blendRectWith(Kernel kernel, uint8_t* pixels, size_t stride, size_t width,
+                                   size_t height, SDL_Color color) {
+    getBlendKernel(kernel)(pixels, stride, width, height, color);
+}
+
+bool SpanRasterizer::isKernelSupported(Kernel kernel) {
+    switch (kernel) {
+#ifdef CPU_FEATURES_X86
+        case KERNEL_AVX2:
+            return CpuFeatures::hasAVX2();
+        case KERNEL_SSE2:
+            return CpuFeatures::hasSSE2();
+#endif
+        case KERNEL_SCALAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char* SpanRasterizer::getKernelName() {
+    return getKernel().name;
+}
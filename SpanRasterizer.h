@@ -0,0 +1,45 @@
+#ifndef SPAN_RASTERIZER_H
+#define SPAN_RASTERIZER_H
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Pixel kernels behind FrameBuffer's rectangle drawing.
+ * blendRect() composites one color over a block of RGBA pixels with the
+ * same rounding as SDL_BLENDMODE_BLEND, a row of spans at a time. On x86
+ * an AVX2 or SSE2 version is picked at runtime from what the CPU
+ * supports; every version produces exactly the bytes of the scalar one.
+ * stride is the distance between rows in bytes.
+ */
+class SpanRasterizer {
+public:
+    // Blending kernels by instruction set
+    enum Kernel {
+        KERNEL_SCALAR,
+        KERNEL_SSE2,
+        KERNEL_AVX2
+    };
+    
+    // Blend color over width x height RGBA pixels
+    static void blendRect(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                          SDL_Color color);
+    // Overwrite width x height RGBA pixels with color
+    static void fillRect(uint8_t* pixels, size_t stride, size_t width, size_t height,
+                         SDL_Color color);
+    
+    // Portable reference blend of a single span of count pixels
+    static void blendScalar(uint8_t* pixels, size_t count, SDL_Color color);
+    
+    // blendRect() with a given kernel instead of the one picked for this
+    // CPU, for checking the kernels against each other; it must be supported
+    static void blendRectWith(Kernel kernel, uint8_t* pixels, size_t stride, size_t width,
+                              size_t height, SDL_Color color);
+    static bool isKernelSupported(Kernel kernel);
+    
+    // Kernel chosen for this CPU: "AVX2", "SSE2" or "scalar"
+    static const char* getKernelName();
+};
+
+#endif // SPAN_RASTERIZER_H
@@ -0,0 +1,83 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring.
+ * One thread pushes, one other thread pops; neither side ever blocks or
+ * takes a lock, so a real-time consumer (the audio callback) cannot be
+ * held up by its producer (no priority inversion). Each index is written
+ * by one side only and lives on its own cache line.
+ *
+ * Items are consumed in FIFO order. The consumer can peek at the front
+ * item and leave it queued, e.g. until the block it is due in.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+        : ring(roundUpToPowerOfTwo(capacity < 2 ? 2 : capacity))
+        , mask(ring.size() - 1)
+        , head(0)
+        , tail(0)
+        , dropped(0)
+    {
+    }
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    // Producer side. Returns false (and drops the item) when full
+    bool push(const T& item) {
+        // Indices grow without wrapping; only the masked value addresses the ring
+        size_t write = tail.load(std::memory_order_relaxed);
+        if (write - head.load(std::memory_order_acquire) > mask) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        
+        ring[write & mask] = item;
+        tail.store(write + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer side. front() is only valid while !empty()
+    bool empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+    
+    const T& front() const {
+        return ring[head.load(std::memory_order_relaxed) & mask];
+    }
+    
+    void pop() {
+        // Releasing the slot lets the producer overwrite it
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    
+    size_t getCapacity() const { return mask + 1; }
+    uint64_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    
+private:
+    std::vector<T> ring;
+    size_t mask;
+    
+    alignas(64) std::atomic<size_t> head;   // Next slot to read (consumer)
+    alignas(64) std::atomic<size_t> tail;   // Next slot to write (producer)
+    std::atomic<uint64_t> dropped;
+    
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+};
+
+#endif // SPSC_QUEUE_H
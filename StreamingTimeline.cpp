@@ -0,0 +1,295 @@
+#include "StreamingTimeline.h"
+#include <algorithm>
+
+// The note buffer is never compacted below this size
+static const size_t MIN_COMPACT_SIZE = 4096;
+
+// openIndex entry of a handle that is not in use
+static const size_t FREE_HANDLE = static_cast<size_t>(-1);
+
+// Keyframes fall on multiples of this song time. One is kept only after at
+// least MIN_KEYFRAME_BYTES of track data, and 16 times its own size
+static const uint32_t KEYFRAME_STEP_MS = 100;
+static const size_t MIN_KEYFRAME_BYTES = 64 * 1024;
+static const size_t KEYFRAME_SPACING_FACTOR = 16;
+
+StreamingTimeline::StreamingTimeline()
+    : noteHead(0)
+    , compactSize(MIN_COMPACT_SIZE)
+    , decodedTime(0)
+    , windowStart(0)
+    , overlapPolicy(NotePairing::FIRST_IN_FIRST_OUT)
+    , nextKeyframeTime(0)
+{
+}
+
+bool StreamingTimeline::open(const std::string& filename) {
+    if (!stream.open(filename)) {
+        return false;
+    }
+    openNotes.setPolicy(overlapPolicy);
+    resetWindow();
+
+    // The spacing rule bounds all keyframes by a fraction of the track data
+    size_t trackBytes = stream.getTrackBytes();
+    keyframes.clear();
+    keyframeArena.release();
+    keyframeArena.reserve(trackBytes / KEYFRAME_SPACING_FACTOR + 2 * stream.getCheckpointSize() + 4096);
+    keyframes.reserve(trackBytes / MIN_KEYFRAME_BYTES + 2);
+
+    recordKeyframe(0, stream.getBytesConsumed());
+    nextKeyframeTime = KEYFRAME_STEP_MS;
+    return true;
+}
+
+void StreamingTimeline::rewind() {
+    restoreKeyframe(0);
+}
+
+void StreamingTimeline::resetWindow() {
+    events.clear();
+    notes.clear();
+    noteHead = 0;
+    compactSize = MIN_COMPACT_SIZE;
+    openNotes.clear();
+    openIndex.clear();
+    freeHandles.clear();
+    decodedTime = 0;
+    windowStart = 0;
+}
+
+void StreamingTimeline::openNote(const NoteInterval& note) {
+    uint32_t handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+    } else {
+        handle = static_cast<uint32_t>(openIndex.size());
+        openIndex.push_back(FREE_HANDLE);
+    }
+    openIndex[handle] = notes.size();
+    openNotes.noteOn(note.track, note.channel, note.key, handle);
+    notes.push_back(note);
+}
+
+void StreamingTimeline::addToWindow(const StreamEvent& event, bool keepEvent) {
+    decodedTime = event.time;
+
+    if (keepEvent) {
+        MidiEvent midiEvent;
+        midiEvent.time = event.time;
+        midiEvent.note = event.note;
+        midiEvent.velocity = event.velocity;
+        midiEvent.isNoteOn = event.isNoteOn;
+        events.push_back(midiEvent);
+    }
+
+    // Notes are paired within their own track and channel, as MidiParser does
+    if (event.isNoteOn) {
+        NoteInterval note;
+        note.start = event.time;
+        note.end = OPEN_END;
+        note.key = event.note;
+        note.velocity = event.velocity;
+        note.channel = event.channel;
+        note.track = event.track;
+        openNote(note);
+    } else {
+        // Open notes are never trimmed, so the index is always in the window
+        uint64_t handle;
+        if (openNotes.noteOff(event.track, event.channel, event.note, handle)) {
+            notes[openIndex[handle]].end = event.time;
+            openIndex[handle] = FREE_HANDLE;
+            freeHandles.push_back(static_cast<uint32_t>(handle));
+        }
+    }
+}
+
+void StreamingTimeline::decode(uint32_t untilTime, bool keepEvents) {
+    // Stop at every keyframe boundary on the way
+    for (;;) {
+        bool atBoundary = nextKeyframeTime <= untilTime;
+        uint32_t end = atBoundary ? nextKeyframeTime - 1 : untilTime;
+
+        decoded.clear();
+        stream.pull(end, decoded);
+        for (const auto& event : decoded) {
+            addToWindow(event, keepEvents);
+        }
+        decodedTime = std::max(decodedTime, end);
+
+        if (!atBoundary || stream.isFinished()) break;
+        reachKeyframeTime(nextKeyframeTime);
+    }
+}
+
+void StreamingTimeline::reachKeyframeTime(uint32_t time) {
+    // Boundaries are only reached in order past the last keyframe, so the
+    // decoder is in the same state whichever way it got here
+    size_t consumed = stream.getBytesConsumed();
+    size_t size = stream.getCheckpointSize() + openNotes.getOpenCount() * sizeof(NoteInterval);
+    size_t spacing = std::max(MIN_KEYFRAME_BYTES, size * KEYFRAME_SPACING_FACTOR);
+    if (consumed - keyframes.back().bytesConsumed >= spacing) {
+        recordKeyframe(time, consumed);
+    }
+    nextKeyframeTime = time + KEYFRAME_STEP_MS;
+}
+
+void StreamingTimeline::recordKeyframe(uint32_t time, size_t bytesConsumed) {
+    keyframes.emplace_back(&keyframeArena);
+    Keyframe& keyframe = keyframes.back();
+    keyframe.time = time;
+    keyframe.bytesConsumed = bytesConsumed;
+    stream.save(keyframe.stream);
+
+    sortOpenNotes();
+    keyframe.openNotes.reserve(openOrder.size());
+    for (const OpenNote& open : openOrder) {
+        keyframe.openNotes.push_back(notes[open.index]);
+    }
+}
+
+void StreamingTimeline::restoreKeyframe(size_t index) {
+    const Keyframe& keyframe = keyframes[index];
+    stream.restore(keyframe.stream);
+    resetWindow();
+
+    // Striking the open notes again in their original order rebuilds the
+    // stacks of repeated keys under either overlap policy
+    for (const NoteInterval& note : keyframe.openNotes) {
+        openNote(note);
+    }
+    decodedTime = keyframe.time > 0 ? keyframe.time - 1 : 0;
+    windowStart = keyframe.time;
+}
+
+void StreamingTimeline::fill(uint32_t untilTime) {
+    decode(untilTime, true);
+}
+
+uint32_t StreamingTimeline::skipTo(uint32_t time) {
+    // Target still inside the buffered window: just drop the events before it
+    if (time >= windowStart && time <= decodedTime) {
+        auto it = std::lower_bound(events.begin(), events.end(), time,
+                                   [](const MidiEvent& e, uint32_t t) { return e.time < t; });
+        discardEvents(static_cast<size_t>(it - events.begin()));
+        trimNotes(time);
+        return time;
+    }
+
+    // Anything before the window has been thrown away: go back to the last
+    // keyframe at or before the target. Going forward, jump to it if it is
+    // ahead of what has been decoded
+    size_t index = static_cast<size_t>(std::upper_bound(keyframes.begin(), keyframes.end(), time,
+        [](uint32_t t, const Keyframe& k) { return t < k.time; }) - keyframes.begin()) - 1;
+    if (time < windowStart || keyframes[index].time > decodedTime + 1) {
+        restoreKeyframe(index);
+    }
+
+    // Decode everything before the target in slices, so that notes which
+    // already ended can be dropped on the way
+    const uint32_t slice = 1000;
+    while (!stream.isFinished() && decodedTime + 1 < time) {
+        decode(std::min(decodedTime + slice, time - 1), false);
+        trimNotes(decodedTime);
+    }
+
+    events.clear();
+    windowStart = time;
+    return time;
+}
+
+uint32_t StreamingTimeline::skipToProgress(float progress) {
+    // Same as skipTo(), with keyframes found by how much data they follow
+    size_t target = static_cast<size_t>(progress * stream.getTrackBytes());
+    size_t consumed = stream.getBytesConsumed();
+    size_t index = static_cast<size_t>(std::upper_bound(keyframes.begin(), keyframes.end(), target,
+        [](size_t bytes, const Keyframe& k) { return bytes < k.bytesConsumed; }) - keyframes.begin());
+    index = index > 0 ? index - 1 : 0;
+    if (target < consumed || keyframes[index].bytesConsumed > consumed) {
+        restoreKeyframe(index);
+    }
+
+    // One event at a time for a precise position; keyframe boundaries are
+    // met before the first event past them is taken
+    StreamEvent event;
+    while (stream.getBytesConsumed() < target && stream.peek(event)) {
+        while (event.time >= nextKeyframeTime) {
+            reachKeyframeTime(nextKeyframeTime);
+        }
+        stream.next(event);
+        addToWindow(event, false);
+        if (notes.size() >= compactSize) {
+            trimNotes(decodedTime);
+        }
+    }
+
+    events.clear();
+    trimNotes(decodedTime);
+    windowStart = decodedTime;
+    return decodedTime;
+}
+
+void StreamingTimeline::discardEvents(size_t count) {
+    if (count == 0) return;
+
+    windowStart = std::max(windowStart, events[std::min(count, events.size()) - 1].time + 1);
+    if (count >= events.size()) {
+        events.clear();
+    } else {
+        events.erase(events.begin(), events.begin() + count);
+    }
+}
+
+void StreamingTimeline::trimNotes(uint32_t beforeTime) {
+    windowStart = std::max(windowStart, beforeTime);
+
+    // Skip the ended notes at the front right away, so that visiting the
+    // window does not walk over them
+    while (noteHead < notes.size() && notes[noteHead].end != OPEN_END &&
+           notes[noteHead].end < beforeTime) {
+        noteHead++;
+    }
+
+    // Ended notes behind a note that is still sounding are only removed
+    // by compaction, once the buffer has doubled since the last one
+    if (noteHead == notes.size()) {
+        notes.clear();
+        noteHead = 0;
+    } else if (notes.size() >= compactSize) {
+        compactNotes(beforeTime);
+    }
+}
+
+void StreamingTimeline::sortOpenNotes() {
+    openOrder.clear();
+    for (size_t handle = 0; handle < openIndex.size(); handle++) {
+        if (openIndex[handle] != FREE_HANDLE) {
+            openOrder.push_back({openIndex[handle], static_cast<uint32_t>(handle)});
+        }
+    }
+    std::sort(openOrder.begin(), openOrder.end());
+}
+
+void StreamingTimeline::compactNotes(uint32_t beforeTime) {
+    // Open notes in buffer order, so they can be matched up with their
+    // handles in one pass
+    sortOpenNotes();
+
+    // Keep the notes that are open or end at beforeTime or later, in order;
+    // the capacity stays, so the buffer stops reallocating after warm-up
+    size_t kept = 0;
+    size_t nextOpen = 0;
+    for (size_t i = noteHead; i < notes.size(); i++) {
+        const NoteInterval& note = notes[i];
+        if (note.end == OPEN_END) {
+            openIndex[openOrder[nextOpen++].handle] = kept;
+        } else if (note.end < beforeTime) {
+            continue;
+        }
+        notes[kept++] = note;
+    }
+    notes.erase(notes.begin() + kept, notes.end());
+    noteHead = 0;
+    compactSize = std::max(MIN_COMPACT_SIZE, kept * 2);
+}
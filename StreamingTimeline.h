@@ -0,0 +1,138 @@
+#ifndef STREAMING_TIMELINE_H
+#define STREAMING_TIMELINE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "MidiStream.h"
+#include "NoteTimeline.h"
+#include "EventScheduler.h"
+#include "NotePairing.h"
+#include "Arena.h"
+
+/**
+ * Sliding-window counterpart of NoteTimeline for streamed files.
+ * Events are decoded from a MidiStream only as far as the look-ahead
+ * requires. Dispatched events and notes that ended are discarded, so
+ * memory is bounded by the look-ahead window plus the notes still
+ * sounding, rather than by the file size.
+ *
+ * Ended notes are dropped one by one, wherever they sit: a note that is
+ * never released only keeps itself buffered, not every note after it.
+ * The note buffer is compacted in place once it has doubled since the
+ * last compaction, so the work is constant per note on average and the
+ * buffer stops reallocating once it has grown to twice the live notes.
+ * Open notes are found through handles into a table of their positions,
+ * which compaction updates.
+ *
+ * While decoding, keyframes are recorded on the way: the decoder's
+ * checkpoint and the open notes at a time boundary. A seek restores the
+ * nearest keyframe before its target and decodes only from there, so
+ * seeking backward or scrubbing never decodes the file from the start
+ * again. A keyframe is kept only once enough track data has passed since
+ * the previous one that keyframes take at most 1/16 of the track data.
+ * That much is reserved when the file is opened, so recording them does
+ * not allocate during playback.
+ */
+class StreamingTimeline {
+public:
+    // End time of a note whose note-off has not been decoded yet
+    static const uint32_t OPEN_END = UINT32_MAX;
+    
+    StreamingTimeline();
+    
+    bool open(const std::string& filename);
+    
+    // Restart from the beginning of the file; keyframes are kept
+    void rewind();
+    
+    // Decode every event up to and including untilTime into the window
+    void fill(uint32_t untilTime);
+    
+    // Decode without keeping events until the given time (or stream
+    // progress) is reached; notes still sounding there stay in the window
+    // and events from that time on are kept. Returns the song time reached.
+    uint32_t skipTo(uint32_t time);
+    uint32_t skipToProgress(float progress);
+    
+    // Drop the first count events (already dispatched) and notes ended before the given time
+    void discardEvents(size_t count);
+    void trimNotes(uint32_t beforeTime);
+    
+    // Visit every buffered note overlapping [from, to]
+    template <typename Visitor>
+    void forEachInRange(uint32_t from, uint32_t to, Visitor&& visit) const {
+        for (size_t i = noteHead; i < notes.size(); i++) {
+            const NoteInterval& note = notes[i];
+            if (note.start > to) break;
+            if (note.end >= from) {
+                visit(note);
+            }
+        }
+    }
+    
+    const std::vector<MidiEvent>& getEvents() const { return events; }
+    size_t getBufferedNoteCount() const { return notes.size() - noteHead; }
+    float getProgress() const { return stream.getProgress(); }
+    bool isFinished() const { return stream.isFinished(); }
+    size_t getFileSize() const { return stream.getFileSize(); }
+    size_t getKeyframeCount() const { return keyframes.size(); }
+    
+    // Takes effect from the next open()
+    void setOverlapPolicy(NotePairing::Policy policy) { overlapPolicy = policy; }
+    
+private:
+    // Position of an open note in the buffer, by handle
+    struct OpenNote {
+        size_t index;
+        uint32_t handle;
+        bool operator<(const OpenNote& other) const { return index < other.index; }
+    };
+    
+    // Every event before time has been decoded and none after
+    struct Keyframe {
+        uint32_t time;
+        size_t bytesConsumed;                   // Track data decoded by then
+        MidiStream::Checkpoint stream;
+        ArenaVector<NoteInterval> openNotes;    // In the order they were struck
+        
+        explicit Keyframe(Arena* arena)
+            : time(0)
+            , bytesConsumed(0)
+            , stream(arena)
+            , openNotes(ArenaAllocator<NoteInterval>(arena))
+        {
+        }
+    };
+    
+    MidiStream stream;
+    std::vector<StreamEvent> decoded;   // Scratch buffer reused between pulls
+    std::vector<MidiEvent> events;      // Decoded, not yet discarded events
+    std::vector<NoteInterval> notes;    // Buffered notes from noteHead on, by start time
+    size_t noteHead;                    // Notes before this one were trimmed
+    size_t compactSize;                 // Buffer size that triggers the next compaction
+    NotePairing openNotes;              // Handles of unterminated notes by track, channel and key
+    std::vector<size_t> openIndex;      // Index in notes of each handle's note
+    std::vector<uint32_t> freeHandles;
+    std::vector<OpenNote> openOrder;    // Scratch buffer of sortOpenNotes()
+    uint32_t decodedTime;               // Everything up to here has been decoded
+    uint32_t windowStart;               // Nothing before here is buffered any more
+    NotePairing::Policy overlapPolicy;
+    
+    Arena keyframeArena;                // Keyframe contents, reserved by open()
+    std::vector<Keyframe> keyframes;    // Ascending; the first is at time 0
+    uint32_t nextKeyframeTime;          // Next boundary past the last keyframe
+    
+    void resetWindow();
+    void openNote(const NoteInterval& note);
+    void addToWindow(const StreamEvent& event, bool keepEvent);
+    void decode(uint32_t untilTime, bool keepEvents);
+    void reachKeyframeTime(uint32_t time);
+    void recordKeyframe(uint32_t time, size_t bytesConsumed);
+    void restoreKeyframe(size_t index);
+    void sortOpenNotes();
+    void compactNotes(uint32_t beforeTime);
+};
+
+#endif // STREAMING_TIMELINE_H
@@ -0,0 +1,199 @@
+#include "Synthesizer.h"
+#include <cmath>
+#include <algorithm>
+
+// Envelope shape (seconds and levels)
+static const float ATTACK_TIME = 0.005f;
+static const float DECAY_TIME = 1.2f;
+static const float SUSTAIN_LEVEL = 0.35f;
+static const float RELEASE_TIME = 0.25f;
+
+// Harmonics of the additive wavetable
+static const int HARMONICS = 8;
+
+// Output gain before the soft clipper; leaves headroom for chords
+static const float MASTER_GAIN = 0.25f;
+
+static const double PI = 3.14159265358979323846;
+
+Synthesizer::Synthesizer()
+    : voiceCount(0)
+    , wavetable(WAVETABLE_SIZE + 1)
+    , sampleRate(0)
+    , noteCounter(0)
+    , stolenVoices(0)
+    , useReferenceKernel(false)
+{
+    // Harmonics fall off like a struck string; normalized to a peak of 1
+    float peak = 0.0f;
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        double phase = 2.0 * PI * i / WAVETABLE_SIZE;
+        double sample = 0.0;
+        for (int h = 1; h <= HARMONICS; h++) {
+            sample += std::sin(phase * h) / std::pow(h, 1.5);
+        }
+        wavetable[i] = static_cast<float>(sample);
+        peak = std::max(peak, std::fabs(wavetable[i]));
+    }
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        wavetable[i] /= peak;
+    }
+    
+    // Guard sample, so interpolation never wraps
+    wavetable[WAVETABLE_SIZE] = wavetable[0];
+    
+    std::fill(phaseSteps, phaseSteps + 128, 0u);
+}
+
+void Synthesizer::setSampleRate(int rate, int maxFrames) {
+    sampleRate = std::max(1, rate);
+    mixBuffer.assign(std::max(1, maxFrames), 0.0f);
+    
+    bank.configure(static_cast<int>(ATTACK_TIME * sampleRate),
+                   static_cast<int>(DECAY_TIME * sampleRate),
+                   SUSTAIN_LEVEL,
+                   static_cast<int>(RELEASE_TIME * sampleRate),
+                   static_cast<int>(mixBuffer.size()));
+    
+    // Phases are 32-bit fixed point, so one table cycle is 2^32
+    for (int note = 0; note < 128; note++) {
+        double frequency = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+        double cycles = std::fmod(frequency / sampleRate, 1.0);
+        phaseSteps[note] = static_cast<uint32_t>(cycles * 4294967296.0);
+    }
+}
+
+int Synthesizer::allocateVoice(int note) {
+    if (voiceCount < MAX_VOICES) return voiceCount++;
+    
+    int sameKey = -1;
+    int quietestReleased = -1;
+    int oldest = 0;
+    
+    for (int i = 0; i < voiceCount; i++) {
+        if (bank.note[i] == note && (sameKey < 0 || bank.startOrder[i] < bank.startOrder[sameKey])) {
+            sameKey = i;
+        }
+        if (bank.stage[i] == VoiceBank::STAGE_RELEASE &&
+            (quietestReleased < 0 || bank.getLevel(i) < bank.getLevel(quietestReleased))) {
+            quietestReleased = i;
+        }
+        if (bank.startOrder[i] < bank.startOrder[oldest]) {
+            oldest = i;
+        }
+    }
+    
+    // Every voice is busy: steal one
+    stolenVoices++;
+    if (sameKey >= 0) return sameKey;
+    if (quietestReleased >= 0) return quietestReleased;
+    return oldest;
+}
+
+void Synthesizer::noteOn(int note, int velocity) {
+    if (note < 0 || note > 127 || sampleRate == 0) return;
+    if (velocity <= 0) {
+        noteOff(note);
+        return;
+    }
+    
+    int voice = allocateVoice(note);
+    float normalized = std::min(velocity, 127) / 127.0f;
+    bank.startVoice(voice, note, normalized * normalized, phaseSteps[note], noteCounter++);
+}
+
+void Synthesizer::noteOff(int note) {
+    // Release the oldest sounding voice of this key, matching the FIFO
+    // pairing of note-ons and note-offs in the parser
+    int target = -1;
+    for (int i = 0; i < voiceCount; i++) {
+        VoiceBank::Stage stage = bank.stage[i];
+        if (bank.note[i] == note && stage != VoiceBank::STAGE_IDLE && stage != VoiceBank::STAGE_RELEASE &&
+            (target < 0 || bank.startOrder[i] < bank.startOrder[target])) {
+            target = i;
+        }
+    }
+    
+    if (target >= 0) {
+        bank.releaseVoice(target);
+    }
+}
+
+void Synthesizer::allNotesOff() {
+    for (int i = 0; i < voiceCount; i++) {
+        if (bank.stage[i] != VoiceBank::STAGE_IDLE && bank.stage[i] != VoiceBank::STAGE_RELEASE) {
+            bank.releaseVoice(i);
+        }
+    }
+}
+
+int Synthesizer::getActiveVoiceCount() const {
+    int count = 0;
+    for (int i = 0; i < voiceCount; i++) {
+        if (bank.stage[i] != VoiceBank::STAGE_IDLE) count++;
+    }
+    return count;
+}
+
+const char* Synthesizer::getKernelName() const {
+    return useReferenceKernel ? "scalar" : VoiceBank::getKernelName();
+}
+
+void Synthesizer::removeIdleVoices() {
+    // Fill each hole with the last voice in use; the vacated lane becomes
+    // idle padding for the SIMD kernels
+    int i = 0;
+    while (i < voiceCount) {
+        if (bank.stage[i] != VoiceBank::STAGE_IDLE) {
+            i++;
+            continue;
+        }
+        voiceCount--;
+        if (i != voiceCount) {
+            bank.moveVoice(voiceCount, i);
+        }
+        bank.clearVoice(voiceCount);
+    }
+}
+
+void Synthesizer::advance(int frames) {
+    int blockSize = static_cast<int>(mixBuffer.size());
+    if (blockSize == 0) return;
+    
+    // Same blocks as render(), so idle voices are removed at the same points
+    for (int offset = 0; offset < frames; offset += blockSize) {
+        bank.advance(std::min(blockSize, frames - offset), voiceCount);
+        removeIdleVoices();
+    }
+}
+
+void Synthesizer::render(float* output, int frames, int channels) {
+    int blockSize = static_cast<int>(mixBuffer.size());
+    if (blockSize == 0) {
+        std::fill(output, output + static_cast<size_t>(frames) * channels, 0.0f);
+        return;
+    }
+    
+    // Blocks larger than the mix buffer are rendered in pieces
+    for (int offset = 0; offset < frames; offset += blockSize) {
+        int count = std::min(blockSize, frames - offset);
+        float* mix = mixBuffer.data();
+        std::fill(mix, mix + count, 0.0f);
+        
+        if (useReferenceKernel) {
+            bank.renderScalar(wavetable.data(), mix, count, voiceCount);
+        } else {
+            bank.render(wavetable.data(), mix, count, voiceCount);
+        }
+        removeIdleVoices();
+        
+        // Soft clipping keeps dense passages from wrapping harshly
+        float* out = output + static_cast<size_t>(offset) * channels;
+        for (int i = 0; i < count; i++) {
+            float sample = std::tanh(mix[i] * MASTER_GAIN);
+            for (int c = 0; c < channels; c++) {
+                *out++ = sample;
+            }
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SYNTHESIZER_H
+#define SYNTHESIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "VoiceBank.h"
+
+/**
+ * Polyphonic wavetable synthesizer for the audio callback.
+ * Every voice plays one additive (piano-like harmonic) wavetable through a
+ * linear ADSR envelope scaled by velocity. Voices live in a struct-of-arrays
+ * VoiceBank whose SIMD kernels mix 4 or 8 voices at once; sounding voices
+ * are kept packed at the front of the bank so idle ones cost nothing. All
+ * buffers are allocated in setSampleRate(), so render() never allocates.
+ *
+ * When all voices are busy a new note steals, in order of preference, a
+ * voice already playing the same key, the quietest released voice, and
+ * finally the oldest voice. Dense (Black MIDI) passages therefore keep
+ * the most recent notes audible instead of dropping them.
+ *
+ * The synthesizer is not thread safe: noteOn(), noteOff() and render()
+ * must all be called from one thread (the audio callback), with other
+ * threads sending notes through an AudioEventQueue.
+ */
+class Synthesizer {
+public:
+    static const int MAX_VOICES = VoiceBank::CAPACITY;
+    static const int WAVETABLE_SIZE = VoiceBank::WAVETABLE_SIZE;
+    
+    Synthesizer();
+    
+    // Must be called before render(); maxFrames is the largest block size
+    // render() is asked for at once (larger blocks are split)
+    void setSampleRate(int sampleRate, int maxFrames);
+    
+    void noteOn(int note, int velocity);
+    void noteOff(int note);
+    void allNotesOff();
+    
+    // Write frames of interleaved float samples, overwriting output
+    void render(float* output, int frames, int channels);
+    
+    // Move every voice forward as render() would, without producing sound.
+    // A copy taken afterwards continues exactly like one that rendered
+    void advance(int frames);
+    
+    // Mix with the portable scalar kernel instead of the SIMD one
+    void setReferenceKernel(bool reference) { useReferenceKernel = reference; }
+    const char* getKernelName() const;
+    
+    int getActiveVoiceCount() const;
+    uint64_t getStolenVoiceCount() const { return stolenVoices; }
+    
+private:
+    VoiceBank bank;
+    int voiceCount;                 // Voices [0, voiceCount) of the bank are in use
+    std::vector<float> wavetable;   // One cycle plus a guard sample
+    std::vector<float> mixBuffer;
+    uint32_t phaseSteps[128];
+    
+    int sampleRate;
+    uint64_t noteCounter;
+    uint64_t stolenVoices;
+    bool useReferenceKernel;
+    
+    int allocateVoice(int note);
+    void removeIdleVoices();
+};
+
+#endif // SYNTHESIZER_H
@@ -0,0 +1,270 @@
+#include "SyntheticMidi.h"
+#include <algorithm>
+
+// xorshift64*: tiny, fast and identical everywhere
+class XorShiftRandom {
+public:
+    explicit XorShiftRandom(uint64_t seed)
+        : state(seed ? seed : 0x9E3779B97F4A7C15ull)
+    {
+    }
+    
+    uint32_t next(uint32_t range) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<uint32_t>(((state * 0x2545F4914F6CDD1Dull) >> 32) % range);
+    }
+    
+private:
+    uint64_t state;
+};
+
+struct SyntheticEvent {
+    uint32_t tick;
+    uint32_t tempo;     // Microseconds per quarter note, for tempo events
+    uint8_t status;     // 0x80/0x90 | channel, or 0xFF for a tempo change
+    uint8_t key;
+    uint8_t velocity;
+};
+
+// Tempo changes first, then note-offs, so a re-struck key is released
+// before it is pressed again
+static int eventOrder(const SyntheticEvent& event) {
+    if (event.status == 0xFF) return 0;
+    if ((event.status & 0xF0) == 0x80 || event.velocity == 0) return 1;
+    return 2;
+}
+
+class SyntheticTrack {
+public:
+    explicit SyntheticTrack(bool runningStatus)
+        : useRunningStatus(runningStatus)
+    {
+    }
+    
+    void addNote(uint32_t tick, uint32_t length, int channel, int key, int velocity) {
+        uint8_t on = static_cast<uint8_t>(0x90 | channel);
+        // With running status note-offs are note-ons at velocity 0, so the
+        // whole track shares one status byte
+        uint8_t off = static_cast<uint8_t>(useRunningStatus ? on : 0x80 | channel);
+        events.push_back({tick, 0, on, static_cast<uint8_t>(key), static_cast<uint8_t>(velocity)});
+        events.push_back({tick + std::max<uint32_t>(1, length), 0, off, static_cast<uint8_t>(key),
+                          static_cast<uint8_t>(useRunningStatus ? 0 : 64)});
+    }
+    
+    void addTempo(uint32_t tick, uint32_t microsecondsPerQuarter) {
+        events.push_back({tick, microsecondsPerQuarter, 0xFF, 0, 0});
+    }
+    
+    // Append the MTrk chunk to out
+    void write(std::vector<uint8_t>& out) {
+        std::sort(events.begin(), events.end(), [](const SyntheticEvent& a, const SyntheticEvent& b) {
+            if (a.tick != b.tick) return a.tick < b.tick;
+            int orderA = eventOrder(a);
+            int orderB = eventOrder(b);
+            if (orderA != orderB) return orderA < orderB;
+            return a.key < b.key;
+        });
+        
+        std::vector<uint8_t> data;
+        data.reserve(events.size() * 4 + 4);
+        uint32_t lastTick = 0;
+        uint8_t runningStatus = 0;
+        for (const SyntheticEvent& event : events) {
+            writeVariableLength(data, event.tick - lastTick);
+            lastTick = event.tick;
+            
+            if (event.status == 0xFF) {
+                data.insert(data.end(), {0xFF, 0x51, 0x03,
+                                         static_cast<uint8_t>(event.tempo >> 16),
+                                         static_cast<uint8_t>(event.tempo >> 8),
+                                         static_cast<uint8_t>(event.tempo)});
+                runningStatus = 0;  // Meta events cancel running status
+                continue;
+            }
+            
+            if (!useRunningStatus || event.status != runningStatus) {
+                data.push_back(event.status);
+                runningStatus = event.status;
+            }
+            data.push_back(event.key);
+            data.push_back(event.velocity);
+        }
+        
+        // End of track
+        data.insert(data.end(), {0x00, 0xFF, 0x2F, 0x00});
+        
+        out.insert(out.end(), {'M', 'T', 'r', 'k'});
+        write32(out, static_cast<uint32_t>(data.size()));
+        out.insert(out.end(), data.begin(), data.end());
+        
+        events.clear();
+        events.shrink_to_fit();
+    }
+    
+    static void write32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+    
+private:
+    bool useRunningStatus;
+    std::vector<SyntheticEvent> events;
+    
+    static void writeVariableLength(std::vector<uint8_t>& out, uint32_t value) {
+        uint8_t bytes[5];
+        int count = 0;
+        do {
+            bytes[count++] = static_cast<uint8_t>(value & 0x7F);
+            value >>= 7;
+        } while (value > 0);
+        
+        while (count > 1) {
+            out.push_back(bytes[--count] | 0x80);
+        }
+        out.push_back(bytes[0]);
+    }
+};
+
+static void writeHeader(std::vector<uint8_t>& out, int trackCount) {
+    out.insert(out.end(), {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1});
+    out.push_back(static_cast<uint8_t>(trackCount >> 8));
+    out.push_back(static_cast<uint8_t>(trackCount));
+    out.push_back(static_cast<uint8_t>(SyntheticMidi::TICKS_PER_QUARTER >> 8));
+    out.push_back(static_cast<uint8_t>(SyntheticMidi::TICKS_PER_QUARTER & 0xFF));
+}
+
+// A key on the 88-key piano (MIDI 21 to 108)
+static int pianoKey(XorShiftRandom& random) {
+    return 21 + static_cast<int>(random.next(88));
+}
+
+const char* SyntheticMidi::getName(Kind kind) {
+    switch (kind) {
+        case MANY_TRACKS: return "many-tracks";
+        case DENSE_CHORDS: return "dense-chords";
+        case RUNNING_STATUS: return "running-status";
+        case TEMPO_CHANGES: return "tempo-changes";
+        case BLACK_MIDI: return "black-midi";
+    }
+    return "unknown";
+}
+
+uint64_t SyntheticMidi::getDefaultNoteCount(Kind kind) {
+    switch (kind) {
+        case MANY_TRACKS: return 500000;
+        case DENSE_CHORDS: return 500000;
+        case RUNNING_STATUS: return 1000000;
+        case TEMPO_CHANGES: return 200000;
+        case BLACK_MIDI: return 10000000;
+    }
+    return 0;
+}
+
+std::vector<uint8_t> SyntheticMidi::generate(Kind kind, uint64_t noteCount, uint64_t seed) {
+    XorShiftRandom random(seed * 0x100000001B3ull + static_cast<uint64_t>(kind));
+    std::vector<uint8_t> file;
+    const uint32_t sixteenth = TICKS_PER_QUARTER / 4;
+    
+    switch (kind) {
+        case MANY_TRACKS: {
+            // 256 tracks playing short phrases one after another
+            const int trackCount = 256;
+            uint64_t perTrack = std::max<uint64_t>(1, noteCount / trackCount);
+            writeHeader(file, trackCount);
+            for (int track = 0; track < trackCount; track++) {
+                SyntheticTrack builder(false);
+                uint32_t tick = random.next(TICKS_PER_QUARTER);
+                for (uint64_t i = 0; i < perTrack; i++) {
+                    uint32_t length = sixteenth * (1 + random.next(4));
+                    builder.addNote(tick, length, track % 16, pianoKey(random), 40 + random.next(80));
+                    tick += sixteenth * (1 + random.next(8));
+                }
+                builder.write(file);
+            }
+            break;
+        }
+        
+        case DENSE_CHORDS: {
+            // 64-note chords on every eighth note, split over 8 tracks
+            const int trackCount = 8;
+            const int chordSize = 64;
+            uint64_t chords = std::max<uint64_t>(1, noteCount / chordSize);
+            writeHeader(file, trackCount);
+            for (int track = 0; track < trackCount; track++) {
+                SyntheticTrack builder(false);
+                XorShiftRandom chordRandom(seed + 77);
+                for (uint64_t chord = 0; chord < chords; chord++) {
+                    uint32_t tick = static_cast<uint32_t>(chord) * (TICKS_PER_QUARTER / 2);
+                    int low = 21 + static_cast<int>(chordRandom.next(88 - chordSize));
+                    for (int voice = track; voice < chordSize; voice += trackCount) {
+                        builder.addNote(tick, TICKS_PER_QUARTER / 2, track, low + voice, 60 + random.next(60));
+                    }
+                }
+                builder.write(file);
+            }
+            break;
+        }
+        
+        case RUNNING_STATUS: {
+            // Overlapping runs on one channel; every event after the first
+            // relies on running status
+            writeHeader(file, 1);
+            SyntheticTrack builder(true);
+            uint32_t tick = 0;
+            for (uint64_t i = 0; i < noteCount; i++) {
+                builder.addNote(tick, sixteenth * (1 + random.next(6)), 0, pianoKey(random), 1 + random.next(126));
+                tick += random.next(4);
+            }
+            builder.write(file);
+            break;
+        }
+        
+        case TEMPO_CHANGES: {
+            // A conductor track changing tempo every few notes, then a
+            // melody track of 128th notes whose times all need the tempo map
+            const uint64_t changes = 5000;
+            const uint32_t step = TICKS_PER_QUARTER / 32;
+            uint64_t notesPerChange = std::max<uint64_t>(1, noteCount / changes);
+            writeHeader(file, 2);
+            
+            SyntheticTrack conductor(false);
+            for (uint64_t i = 0; i < changes; i++) {
+                uint32_t tick = static_cast<uint32_t>(i * notesPerChange) * step;
+                conductor.addTempo(tick, 300000 + random.next(700000));
+            }
+            conductor.write(file);
+            
+            SyntheticTrack melody(false);
+            for (uint64_t i = 0; i < noteCount; i++) {
+                uint32_t tick = static_cast<uint32_t>(i) * step;
+                melody.addNote(tick, sixteenth * (1 + random.next(3)), 0, pianoKey(random), 40 + random.next(80));
+            }
+            melody.write(file);
+            break;
+        }
+        
+        case BLACK_MIDI: {
+            // 16 tracks of running-status notes, a few starting on every
+            // tick, so thousands sound at once
+            const int trackCount = 16;
+            uint64_t perTrack = std::max<uint64_t>(1, noteCount / trackCount);
+            writeHeader(file, trackCount);
+            for (int track = 0; track < trackCount; track++) {
+                SyntheticTrack builder(true);
+                uint32_t tick = 0;
+                for (uint64_t i = 0; i < perTrack; i++) {
+                    uint32_t length = 1 + random.next(TICKS_PER_QUARTER);
+                    builder.addNote(tick, length, track, pianoKey(random), 1 + random.next(126));
+                    tick += random.next(2);
+                }
+                builder.write(file);
+            }
+            break;
+        }
+    }
+    
+    return file;
+}
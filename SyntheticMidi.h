@@ -0,0 +1,38 @@
+#ifndef SYNTHETIC_MIDI_H
+#define SYNTHETIC_MIDI_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Deterministic generator of Standard MIDI Files for benchmarks.
+ * Each kind stresses one part of loading or playback; the same kind, note
+ * count and seed always give the same bytes on every platform (the random
+ * numbers come from a fixed xorshift generator, not from <random>
+ * distributions).
+ */
+class SyntheticMidi {
+public:
+    enum Kind {
+        MANY_TRACKS,        // Hundreds of short tracks, explicit status bytes
+        DENSE_CHORDS,       // Wide chords struck together on every beat
+        RUNNING_STATUS,     // One track of running status, note-offs as velocity 0
+        TEMPO_CHANGES,      // Thousands of tempo changes under a steady melody
+        BLACK_MIDI          // Millions of overlapping notes on 16 tracks
+    };
+    
+    static const int KIND_COUNT = 5;
+    static const uint16_t TICKS_PER_QUARTER = 480;
+    
+    // Short name used in results and file names, e.g. "black-midi"
+    static const char* getName(Kind kind);
+    
+    // Note count of a kind at benchmark scale 1
+    static uint64_t getDefaultNoteCount(Kind kind);
+    
+    // A format 1 file holding noteCount notes (give or take a chord)
+    static std::vector<uint8_t> generate(Kind kind, uint64_t noteCount, uint64_t seed = 1);
+};
+
+#endif // SYNTHETIC_MIDI_H
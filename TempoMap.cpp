@@ -0,0 +1,102 @@
+#include "TempoMap.h"
+#include <algorithm>
+
+TempoMap::TempoMap()
+    : ticksPerQuarterNote(480)
+    , smpte(false)
+    , usPerTickNum(1)
+    , usPerTickDen(1)
+{
+}
+
+void TempoMap::clear() {
+    segments.clear();
+    ticksPerQuarterNote = 480;
+    smpte = false;
+    usPerTickNum = 1;
+    usPerTickDen = 1;
+}
+
+void TempoMap::setTicksPerQuarterNote(uint16_t ticks) {
+    ticksPerQuarterNote = ticks > 0 ? ticks : 480;
+    smpte = false;
+}
+
+void TempoMap::setSmpte(uint8_t framesPerSecond, uint8_t ticksPerFrame) {
+    smpte = true;
+    if (ticksPerFrame == 0) ticksPerFrame = 1;
+    
+    if (framesPerSecond == 29) {
+        // 29.97 fps = 30000 / 1001 frames per second
+        usPerTickNum = 1001000000ULL;
+        usPerTickDen = 30000ULL * ticksPerFrame;
+    } else {
+        usPerTickNum = 1000000ULL;
+        usPerTickDen = static_cast<uint64_t>(framesPerSecond > 0 ? framesPerSecond : 25) * ticksPerFrame;
+    }
+}
+
+void TempoMap::addTempoChange(uint64_t tick, uint32_t microsecondsPerQuarter) {
+    if (microsecondsPerQuarter == 0) return;
+    
+    Segment segment;
+    segment.tick = tick;
+    segment.scaledTime = 0;
+    segment.tempo = microsecondsPerQuarter;
+    segments.push_back(segment);
+}
+
+void TempoMap::finalize() {
+    // Stable so that of several changes on the same tick the last one wins
+    std::stable_sort(segments.begin(), segments.end(),
+                     [](const Segment& a, const Segment& b) { return a.tick < b.tick; });
+    
+    std::vector<Segment> merged;
+    merged.reserve(segments.size() + 1);
+    
+    // Until the first Set Tempo event the default tempo applies
+    if (segments.empty() || segments.front().tick > 0) {
+        merged.push_back({0, 0, DEFAULT_TEMPO});
+    }
+    
+    for (const auto& segment : segments) {
+        if (!merged.empty() && merged.back().tick == segment.tick) {
+            merged.back().tempo = segment.tempo;
+        } else {
+            merged.push_back(segment);
+        }
+    }
+    
+    // Prefix sum of segment durations; nothing is divided here, so no
+    // rounding error carries over from one segment to the next
+    for (size_t i = 1; i < merged.size(); i++) {
+        const Segment& prev = merged[i - 1];
+        merged[i].scaledTime = prev.scaledTime + (merged[i].tick - prev.tick) * prev.tempo;
+    }
+    
+    segments.swap(merged);
+}
+
+uint64_t TempoMap::ticksToMicroseconds(uint64_t tick) const {
+    if (smpte) {
+        // Split the product so it cannot overflow on very long files
+        return (tick / usPerTickDen) * usPerTickNum +
+               (tick % usPerTickDen) * usPerTickNum / usPerTickDen;
+    }
+    
+    if (segments.empty()) {
+        return tick * DEFAULT_TEMPO / ticksPerQuarterNote;
+    }
+    
+    // Last segment starting at or before the tick
+    auto it = std::upper_bound(segments.begin(), segments.end(), tick,
+                               [](uint64_t t, const Segment& s) { return t < s.tick; });
+    const Segment& segment = *(it - 1);
+    
+    return (segment.scaledTime + (tick - segment.tick) * segment.tempo) / ticksPerQuarterNote;
+}
+
+uint32_t TempoMap::ticksToMilliseconds(uint64_t tick) const {
+    uint64_t ms = ticksToMicroseconds(tick) / 1000;
+    return ms > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ms);
+}
@@ -0,0 +1,54 @@
+#ifndef TEMPO_MAP_H
+#define TEMPO_MAP_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Global tick-to-time mapping for a MIDI file.
+ * Set Tempo events from every track are collected first, then finalize()
+ * sorts them and stores the absolute time at which each tempo segment
+ * starts (a prefix sum), so converting a tick is a binary search plus one
+ * multiply. Segment start times are kept exactly, in units of
+ * 1/ticksPerQuarterNote microseconds, and only the final result is
+ * rounded down, so dense tempo maps do not accumulate rounding drift.
+ */
+class TempoMap {
+public:
+    static const uint32_t DEFAULT_TEMPO = 500000; // 120 BPM
+    
+    TempoMap();
+    
+    void clear();
+    void setTicksPerQuarterNote(uint16_t ticks);
+    // SMPTE timing; framesPerSecond is 24, 25, 29 (29.97 drop frame) or 30
+    void setSmpte(uint8_t framesPerSecond, uint8_t ticksPerFrame);
+    void addTempoChange(uint64_t tick, uint32_t microsecondsPerQuarter);
+    
+    // Build the segment table; must be called before any conversion
+    void finalize();
+    
+    uint64_t ticksToMicroseconds(uint64_t tick) const;
+    uint32_t ticksToMilliseconds(uint64_t tick) const;
+    
+    bool isSmpte() const { return smpte; }
+    size_t getSegmentCount() const { return segments.size(); }
+    
+private:
+    struct Segment {
+        uint64_t tick;          // First tick of the segment
+        uint64_t scaledTime;    // Absolute time of that tick, in us * ticksPerQuarterNote
+        uint32_t tempo;         // Microseconds per quarter note
+    };
+    std::vector<Segment> segments;
+    
+    uint16_t ticksPerQuarterNote;
+    
+    // SMPTE files have a fixed rate of usPerTickNum / usPerTickDen microseconds per tick
+    bool smpte;
+    uint64_t usPerTickNum;
+    uint64_t usPerTickDen;
+};
+
+#endif // TEMPO_MAP_H
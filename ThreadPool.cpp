@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : task(nullptr)
+    , taskCount(0)
+    , nextIndex(0)
+    , activeWorkers(0)
+    , generation(0)
+    , stopping(false)
+{
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    
+    // The caller of parallelFor() is one of the threads
+    for (size_t i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& function) {
+    if (count == 0) return;
+    
+    // Not worth waking anyone up
+    if (count == 1 || workers.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            function(i);
+        }
+        return;
+    }
+    
+    std::lock_guard<std::mutex> jobLock(jobMutex);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &function;
+        taskCount = count;
+        nextIndex.store(0);
+        activeWorkers = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    
+    runTasks();
+    
+    // Wait for workers still finishing their last index
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return activeWorkers == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::runTasks() {
+    for (;;) {
+        size_t index = nextIndex.fetch_add(1);
+        if (index >= taskCount) break;
+        (*task)(index);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seenGeneration = 0;
+    
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+        
+        runTasks();
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeWorkers--;
+        }
+        finished.notify_one();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Small fixed-size worker pool for data-parallel loops.
+ * parallelFor() hands out indices dynamically, so uneven work items (a
+ * huge track next to a tiny one) still keep every worker busy. The calling
+ * thread works on the loop too and returns once every index is done.
+ * Jobs are not nestable: do not call parallelFor() from inside a task.
+ */
+class ThreadPool {
+public:
+    // threadCount = 0 uses one thread per hardware core
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    // Number of threads working on a job, including the caller
+    size_t getThreadCount() const { return workers.size() + 1; }
+    
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+    
+    // Process-wide pool, created on first use
+    static ThreadPool& shared();
+    
+private:
+    std::vector<std::thread> workers;
+    
+    std::mutex jobMutex;            // Serializes parallelFor() callers
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    
+    const std::function<void(size_t)>* task;
+    size_t taskCount;
+    std::atomic<size_t> nextIndex;
+    size_t activeWorkers;
+    uint64_t generation;
+    bool stopping;
+    
+    void workerLoop();
+    void runTasks();
+};
+
+#endif // THREAD_POOL_H
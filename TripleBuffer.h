@@ -0,0 +1,66 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single-writer/single-reader triple buffer.
+ * The writer fills the back slot and publishes it; the reader takes the
+ * newest published slot whenever it is ready for one. Neither side waits
+ * for the other: a slow reader simply skips the states it never took, and
+ * a fast reader keeps the last one. The three slots only trade owners,
+ * so items keep their allocations (e.g. vector capacity) between uses,
+ * and the writer must overwrite everything it publishes.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer()
+        : writeIndex(0)
+        , readIndex(2)
+        , middle(1)
+    {
+    }
+    
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+    
+    // Writer side: the slot to fill, then publish() hands it over
+    T& getWriteBuffer() {
+        return slots[writeIndex];
+    }
+    
+    void publish() {
+        writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+    
+    // True while the last published slot has not been taken by the reader
+    bool hasUnread() const {
+        return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+    
+    // Reader side: take the newest published slot, if there is one.
+    // Returns false (keeping the current slot) when nothing new arrived
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+        
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    
+    const T& read() const {
+        return slots[readIndex];
+    }
+    
+private:
+    static const uint8_t INDEX_MASK = 3;
+    static const uint8_t FRESH = 4;         // Set while the middle slot is unread
+    
+    T slots[3];
+    alignas(64) uint8_t writeIndex;         // Owned by the writer
+    alignas(64) uint8_t readIndex;          // Owned by the reader
+    alignas(64) std::atomic<uint8_t> middle;
+};
+
+#endif // TRIPLE_BUFFER_H
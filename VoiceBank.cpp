@@ -0,0 +1,355 @@
+#include "VoiceBank.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+
+static const uint32_t PHASE_FRACTION_MASK = (1u << VoiceBank::PHASE_FRACTION_BITS) - 1;
+static const float PHASE_FRACTION_SCALE = 1.0f / (1u << VoiceBank::PHASE_FRACTION_BITS);
+
+VoiceBank::VoiceBank()
+    : attackFrames(1)
+    , decayFrames(1)
+    , releaseFrames(1)
+    , sustainLevel(0.0f)
+{
+    for (int i = 0; i < CAPACITY; i++) {
+        clearVoice(i);
+    }
+}
+
+void VoiceBank::configure(int attack, int decay, float sustain, int release, int maxFrames) {
+    attackFrames = static_cast<uint32_t>(std::max(1, attack));
+    decayFrames = static_cast<uint32_t>(std::max(1, decay));
+    releaseFrames = static_cast<uint32_t>(std::max(1, release));
+    sustainLevel = sustain;
+    laneMix.assign(static_cast<size_t>(std::max(1, maxFrames)) * LANE_GROUP, 0.0f);
+}
+
+void VoiceBank::startVoice(int index, int voiceNote, float voiceGain, uint32_t voicePhaseStep,
+                           uint64_t order) {
+    stage[index] = STAGE_ATTACK;
+    base[index] = 0.0f;
+    step[index] = 1.0f / attackFrames;
+    elapsed[index] = 0;
+    length[index] = attackFrames;
+    gain[index] = voiceGain;
+    phase[index] = 0;
+    phaseStep[index] = voicePhaseStep;
+    note[index] = static_cast<uint8_t>(voiceNote);
+    startOrder[index] = order;
+}
+
+void VoiceBank::releaseVoice(int index) {
+    float level = getLevel(index);
+    
+    // A voice that has not risen yet has nothing to fade
+    if (level <= 0.0f) {
+        stage[index] = STAGE_RELEASE;
+        finishStage(index);
+        return;
+    }
+    
+    // Every release takes the same time, whatever level it starts from
+    stage[index] = STAGE_RELEASE;
+    base[index] = level;
+    step[index] = -level / releaseFrames;
+    elapsed[index] = 0;
+    length[index] = releaseFrames;
+}
+
+void VoiceBank::clearVoice(int index) {
+    stage[index] = STAGE_IDLE;
+    base[index] = 0.0f;
+    step[index] = 0.0f;
+    elapsed[index] = 0;
+    length[index] = HOLD;
+    gain[index] = 0.0f;
+    phase[index] = 0;
+    phaseStep[index] = 0;
+    note[index] = 0;
+    startOrder[index] = 0;
+}
+
+void VoiceBank::moveVoice(int from, int to) {
+    stage[to] = stage[from];
+    base[to] = base[from];
+    step[to] = step[from];
+    elapsed[to] = elapsed[from];
+    length[to] = length[from];
+    gain[to] = gain[from];
+    phase[to] = phase[from];
+    phaseStep[to] = phaseStep[from];
+    note[to] = note[from];
+    startOrder[to] = startOrder[from];
+}
+
+float VoiceBank::getLevel(int index) const {
+    // Same arithmetic as the kernels, which convert the count as signed
+    return base[index] + step[index] * static_cast<float>(static_cast<int32_t>(elapsed[index]));
+}
+
+void VoiceBank::finishStage(int index) {
+    elapsed[index] = 0;
+    switch (stage[index]) {
+        case STAGE_ATTACK:
+            stage[index] = STAGE_DECAY;
+            base[index] = 1.0f;
+            step[index] = (sustainLevel - 1.0f) / decayFrames;
+            length[index] = decayFrames;
+            break;
+        case STAGE_DECAY:
+            stage[index] = STAGE_SUSTAIN;
+            base[index] = sustainLevel;
+            step[index] = 0.0f;
+            length[index] = HOLD;
+            break;
+        case STAGE_RELEASE:
+            stage[index] = STAGE_IDLE;
+            base[index] = 0.0f;
+            step[index] = 0.0f;
+            length[index] = HOLD;
+            break;
+        default:
+            // Holding stages just restart their count
+            break;
+    }
+}
+
+void VoiceBank::renderScalar(const float* table, float* mix, int frames, int count) {
+    for (int v = 0; v < count; v++) {
+        if (stage[v] == STAGE_IDLE) continue;
+        
+        for (int i = 0; i < frames; i++) {
+            if (++elapsed[v] == length[v]) {
+                finishStage(v);
+            }
+            float level = getLevel(v);
+            
+            // Linear interpolation between wavetable samples
+            uint32_t index = phase[v] >> PHASE_FRACTION_BITS;
+            float fraction = static_cast<float>(phase[v] & PHASE_FRACTION_MASK) * PHASE_FRACTION_SCALE;
+            float sample = table[index] + fraction * (table[index + 1] - table[index]);
+            mix[i] += sample * (level * gain[v]);
+            
+            // The phase wraps around the table on its own
+            phase[v] += phaseStep[v];
+        }
+    }
+}
+
+void VoiceBank::advance(int frames, int count) {
+    for (int v = 0; v < count; v++) {
+        if (stage[v] == STAGE_IDLE) continue;
+        
+        // Skip to each stage end in turn, exactly where render() would
+        uint32_t remaining = static_cast<uint32_t>(frames);
+        while (length[v] - elapsed[v] <= remaining) {
+            remaining -= length[v] - elapsed[v];
+            finishStage(v);
+        }
+        elapsed[v] += remaining;
+        phase[v] += phaseStep[v] * static_cast<uint32_t>(frames);
+    }
+}
+
+#ifdef CPU_FEATURES_X86
+
+// Both SIMD kernels walk a group of voices through the whole block with its
+// state in registers, adding every sample into a per-lane partial sum; the
+// lanes are summed into mix once at the end. A stage ending is rare, so the
+// group's counts are then spilled and finishStage() runs for those lanes.
+
+CPU_TARGET("sse2")
+static void renderSSE2(VoiceBank& bank, const float* table, float* mix, float* laneMix,
+                       int frames, int count) {
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i fractionMask = _mm_set1_epi32(static_cast<int>(PHASE_FRACTION_MASK));
+    const __m128 fractionScale = _mm_set1_ps(PHASE_FRACTION_SCALE);
+    std::fill(laneMix, laneMix + static_cast<size_t>(frames) * 4, 0.0f);
+    
+    for (int v = 0; v < count; v += 4) {
+        __m128 base = _mm_load_ps(bank.base + v);
+        __m128 step = _mm_load_ps(bank.step + v);
+        __m128i elapsed = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.elapsed + v));
+        __m128i length = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.length + v));
+        __m128 gain = _mm_load_ps(bank.gain + v);
+        __m128i phase = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.phase + v));
+        __m128i phaseStep = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.phaseStep + v));
+        
+        for (int i = 0; i < frames; i++) {
+            elapsed = _mm_add_epi32(elapsed, one);
+            int reached = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(elapsed, length)));
+            if (reached) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(bank.elapsed + v), elapsed);
+                for (int lane = 0; lane < 4; lane++) {
+                    if (reached & (1 << lane)) bank.finishStage(v + lane);
+                }
+                base = _mm_load_ps(bank.base + v);
+                step = _mm_load_ps(bank.step + v);
+                elapsed = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.elapsed + v));
+                length = _mm_load_si128(reinterpret_cast<const __m128i*>(bank.length + v));
+            }
+            __m128 level = _mm_add_ps(base, _mm_mul_ps(step, _mm_cvtepi32_ps(elapsed)));
+            
+            // SSE2 has no gather, so the table is read one lane at a time
+            alignas(16) uint32_t index[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                            _mm_srli_epi32(phase, VoiceBank::PHASE_FRACTION_BITS));
+            __m128 t0 = _mm_setr_ps(table[index[0]], table[index[1]],
+                                    table[index[2]], table[index[3]]);
+            __m128 t1 = _mm_setr_ps(table[index[0] + 1], table[index[1] + 1],
+                                    table[index[2] + 1], table[index[3] + 1]);
+            __m128 fraction = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(phase, fractionMask)),
+                                         fractionScale);
+            __m128 sample = _mm_add_ps(t0, _mm_mul_ps(fraction, _mm_sub_ps(t1, t0)));
+            
+            float* lanes = laneMix + static_cast<size_t>(i) * 4;
+            __m128 out = _mm_mul_ps(sample, _mm_mul_ps(level, gain));
+            _mm_storeu_ps(lanes, _mm_add_ps(_mm_loadu_ps(lanes), out));
+            
+            phase = _mm_add_epi32(phase, phaseStep);
+        }
+        
+        _mm_store_si128(reinterpret_cast<__m128i*>(bank.elapsed + v), elapsed);
+        _mm_store_si128(reinterpret_cast<__m128i*>(bank.phase + v), phase);
+    }
+    
+    for (int i = 0; i < frames; i++) {
+        const float* lanes = laneMix + static_cast<size_t>(i) * 4;
+        mix[i] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+}
+
+CPU_TARGET("avx2")
+static void renderAVX2(VoiceBank& bank, const float* table, float* mix, float* laneMix,
+                       int frames, int count) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i fractionMask = _mm256_set1_epi32(static_cast<int>(PHASE_FRACTION_MASK));
+    const __m256 fractionScale = _mm256_set1_ps(PHASE_FRACTION_SCALE);
+    std::fill(laneMix, laneMix + static_cast<size_t>(frames) * 8, 0.0f);
+    
+    for (int v = 0; v < count; v += 8) {
+        __m256 base = _mm256_load_ps(bank.base + v);
+        __m256 step = _mm256_load_ps(bank.step + v);
+        __m256i elapsed = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.elapsed + v));
+        __m256i length = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.length + v));
+        __m256 gain = _mm256_load_ps(bank.gain + v);
+        __m256i phase = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.phase + v));
+        __m256i phaseStep = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.phaseStep + v));
+        
+        for (int i = 0; i < frames; i++) {
+            elapsed = _mm256_add_epi32(elapsed, one);
+            int reached = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(elapsed, length)));
+            if (reached) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(bank.elapsed + v), elapsed);
+                for (int lane = 0; lane < 8; lane++) {
+                    if (reached & (1 << lane)) bank.finishStage(v + lane);
+                }
+                base = _mm256_load_ps(bank.base + v);
+                step = _mm256_load_ps(bank.step + v);
+                elapsed = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.elapsed + v));
+                length = _mm256_load_si256(reinterpret_cast<const __m256i*>(bank.length + v));
+            }
+            __m256 level = _mm256_add_ps(base, _mm256_mul_ps(step, _mm256_cvtepi32_ps(elapsed)));
+            
+            __m256i index = _mm256_srli_epi32(phase, VoiceBank::PHASE_FRACTION_BITS);
+            __m256 t0 = _mm256_i32gather_ps(table, index, 4);
+            __m256 t1 = _mm256_i32gather_ps(table + 1, index, 4);
+            __m256 fraction = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(phase, fractionMask)),
+                                            fractionScale);
+            __m256 sample = _mm256_add_ps(t0, _mm256_mul_ps(fraction, _mm256_sub_ps(t1, t0)));
+            
+            float* lanes = laneMix + static_cast<size_t>(i) * 8;
+            __m256 out = _mm256_mul_ps(sample, _mm256_mul_ps(level, gain));
+            _mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_loadu_ps(lanes), out));
+            
+            phase = _mm256_add_epi32(phase, phaseStep);
+        }
+        
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bank.elapsed + v), elapsed);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(bank.phase + v), phase);
+    }
+    
+    for (int i = 0; i < frames; i++) {
+        __m256 lanes = _mm256_loadu_ps(laneMix + static_cast<size_t>(i) * 8);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(lanes), _mm256_extractf128_ps(lanes, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        mix[i] += _mm_cvtss_f32(sum);
+    }
+    
+    // Avoid AVX to SSE transition stalls in the caller
+    _mm256_zeroupper();
+}
+
+#endif // CPU_FEATURES_X86
+
+static void renderScalarKernel(VoiceBank& bank, const float* table, float* mix, float* laneMix,
+                               int frames, int count) {
+    (void)laneMix;
+    bank.renderScalar(table, mix, frames, count);
+}
+
+typedef void (*MixKernel)(VoiceBank& bank, const float* table, float* mix, float* laneMix,
+                          int frames, int count);
+
+struct KernelChoice {
+    VoiceBank::Kernel kernel;
+    const char* name;
+};
+
+static KernelChoice selectKernel() {
+    if (VoiceBank::isKernelSupported(VoiceBank::KERNEL_AVX2)) return {VoiceBank::KERNEL_AVX2, "AVX2"};
+    if (VoiceBank::isKernelSupported(VoiceBank::KERNEL_SSE2)) return {VoiceBank::KERNEL_SSE2, "SSE2"};
+    return {VoiceBank::KERNEL_SCALAR, "scalar"};
+}
+
+static MixKernel getMixKernel(VoiceBank::Kernel kernel) {
+#ifdef CPU_FEATURES_X86
+    if (kernel == VoiceBank::KERNEL_AVX2) return renderAVX2;
+    if (kernel == VoiceBank::KERNEL_SSE2) return renderSSE2;
+#else
+    (void)kernel;
+#endif
+    return renderScalarKernel;
+}
+
+// Chosen once, on first use
+static const KernelChoice& getKernel() {
+    static const KernelChoice choice = selectKernel();
+    return choice;
+}
+
+void VoiceBank::render(const float* table, float* mix, int frames, int count) {
+    renderWith(getKernel().kernel, table, mix, frames, count);
+}
+
+void VoiceBank::renderWith(Kernel kernel, const float* table, float* mix, int frames, int count) {
+    if (count <= 0 || frames <= 0) return;
+    MixKernel mixKernel = getMixKernel(kernel);
+    
+    // Blocks longer than the configured size are rendered in pieces
+    int blockSize = static_cast<int>(laneMix.size() / LANE_GROUP);
+    for (int offset = 0; offset < frames; offset += blockSize) {
+        int length = std::min(blockSize, frames - offset);
+        mixKernel(*this, table, mix + offset, laneMix.data(), length, count);
+    }
+}
+
+bool VoiceBank::isKernelSupported(Kernel kernel) {
+    switch (kernel) {
+#ifdef CPU_FEATURES_X86
+        case KERNEL_AVX2:
+            return CpuFeatures::hasAVX2();
+        case KERNEL_SSE2:
+            return CpuFeatures::hasSSE2();
+#endif
+        case KERNEL_SCALAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char* VoiceBank::getKernelName() {
+    return getKernel().name;
+}
@@ -0,0 +1,98 @@
+#ifndef VOICE_BANK_H
+#define VOICE_BANK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Struct-of-arrays voice state of the synthesizer and the kernels that
+ * render it. Each voice is a lane: a fixed-point wavetable phase, a linear
+ * envelope segment and a velocity gain. The envelope level is
+ * base + step * elapsed, where elapsed counts the samples since the stage
+ * began and the stage ends after exactly length samples, so the state can
+ * be moved forward by any number of samples without rendering them
+ * (advance()) and still match a rendered run bit for bit.
+ *
+ * render() mixes voices [0, count) into a mono buffer. On x86 an AVX2 or
+ * SSE2 kernel is picked at runtime, processing 8 or 4 voices at once;
+ * renderScalar() is the portable reference. The kernels run the same
+ * arithmetic per voice, only the order in which voices are summed differs.
+ * Lanes past count up to the next multiple of LANE_GROUP must be idle.
+ */
+class VoiceBank {
+public:
+    static const int CAPACITY = 1024;
+    static const int LANE_GROUP = 8;        // Widest kernel; CAPACITY is a multiple
+    static const int TABLE_BITS = 11;
+    static const int WAVETABLE_SIZE = 1 << TABLE_BITS;
+    static const int PHASE_FRACTION_BITS = 32 - TABLE_BITS;
+    static const uint32_t HOLD = 0xFFFFFFFFu;  // Length of stages that never end
+    
+    enum Stage : uint8_t {
+        STAGE_IDLE,
+        STAGE_ATTACK,
+        STAGE_DECAY,
+        STAGE_SUSTAIN,
+        STAGE_RELEASE
+    };
+    
+    // Mixing kernels by instruction set
+    enum Kernel {
+        KERNEL_SCALAR,
+        KERNEL_SSE2,
+        KERNEL_AVX2
+    };
+    
+    // Per-voice state, indexed by lane
+    alignas(32) float base[CAPACITY];       // Level when the stage began
+    alignas(32) float step[CAPACITY];       // Level change per sample
+    alignas(32) uint32_t elapsed[CAPACITY]; // Samples into the stage
+    alignas(32) uint32_t length[CAPACITY];  // Samples until the stage ends
+    alignas(32) float gain[CAPACITY];
+    alignas(32) uint32_t phase[CAPACITY];   // Table index in the top TABLE_BITS
+    alignas(32) uint32_t phaseStep[CAPACITY];
+    Stage stage[CAPACITY];
+    uint8_t note[CAPACITY];
+    uint64_t startOrder[CAPACITY];          // Larger is newer
+    
+    VoiceBank();
+    
+    // Envelope shape in samples; maxFrames is the largest block render()
+    // works on at once (longer ones are split)
+    void configure(int attackFrames, int decayFrames, float sustainLevel, int releaseFrames,
+                   int maxFrames);
+    
+    void startVoice(int index, int note, float gain, uint32_t phaseStep, uint64_t order);
+    void releaseVoice(int index);
+    void clearVoice(int index);
+    void moveVoice(int from, int to);
+    float getLevel(int index) const;
+    
+    // Enter the next envelope stage once the current one has run its length
+    void finishStage(int index);
+    
+    // Add voices [0, count) to mix; table holds WAVETABLE_SIZE + 1 samples
+    void render(const float* table, float* mix, int frames, int count);
+    void renderScalar(const float* table, float* mix, int frames, int count);
+    
+    // render() with a given kernel instead of the one picked for this CPU,
+    // for checking the kernels against each other; it must be supported
+    void renderWith(Kernel kernel, const float* table, float* mix, int frames, int count);
+    static bool isKernelSupported(Kernel kernel);
+    
+    // Move voices [0, count) forward by frames samples without rendering
+    void advance(int frames, int count);
+    
+    // Kernel chosen for this CPU: "AVX2", "SSE2" or "scalar"
+    static const char* getKernelName();
+    
+private:
+    uint32_t attackFrames;
+    uint32_t decayFrames;
+    uint32_t releaseFrames;
+    float sustainLevel;
+    std::vector<float> laneMix;     // Per-lane partial sums of one block
+};
+
+#endif // VOICE_BANK_H
@@ -1,21 +1,93 @@
 #include "WaterfallPiano.h"
-#include "MidiParser.h"
+#include "SongCache.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <fstream>
+#include <chrono>
+
+// Capacity of each audio event queue; a full queue drops events
+static const size_t AUDIO_QUEUE_CAPACITY = 64 * 1024;
+
+// Playback events are scheduled this far (plus one audio buffer) ahead of
+// the audio clock, so the events of one ~16 ms video frame keep their
+// spacing instead of all sounding at the start of the next audio block
+static const int AUDIO_SCHEDULE_AHEAD_MS = 20;
+
+// Playback is stepped this often, whatever the display refresh rate
+static const int SIMULATION_RATE = 1000;
+
+// Playback commands are a few per key press; a full queue drops them
+static const size_t PLAYBACK_COMMAND_CAPACITY = 256;
+
+// The copied note window reaches this far past the screen, so it still
+// covers the view after the song moved on for a few slow frames
+static const uint32_t NOTE_WINDOW_MARGIN_MS = 250;
+
+// Scrub bar along the top of the window; it can be grabbed a little below
+// its visible edge
+static const int SCRUB_BAR_HEIGHT = 6;
+static const int SCRUB_BAR_GRAB_HEIGHT = 20;
+
+static bool isSeekCommand(const PlaybackCommand& command) {
+    return command.type == PlaybackCommand::SEEK || command.type == PlaybackCommand::SCRUB;
+}
+
+static void applyAudioEvent(Synthesizer& synth, const AudioEvent& event) {
+    switch (event.type) {
+        case AudioEvent::NOTE_ON:
+            synth.noteOn(event.note, event.velocity);
+            break;
+        case AudioEvent::NOTE_OFF:
+            synth.noteOff(event.note);
+            break;
+        case AudioEvent::ALL_NOTES_OFF:
+            synth.allNotesOff();
+            break;
+    }
+}
 
 WaterfallPiano::WaterfallPiano() 
     : window(nullptr)
     , renderer(nullptr)
     , waterfallTexture(nullptr)
-    , running(false)
+    , keyboardTexture(nullptr)
+    , layersDirty(true)
+    , noteRingTexture(nullptr)
+    , incrementalWaterfall(true)
+    , noteRingValid(false)
+    , noteRingTop(0)
+    , frameDrawCalls(0)
+    , frameRects(0)
+    , simulationRunning(false)
+    , playbackCommands(PLAYBACK_COMMAND_CAPACITY)
+    , audioDevice(0)
+    , audioSampleRate(0)
+    , audioLatencyFrames(0)
+    , scheduledAudio(AUDIO_QUEUE_CAPACITY)
+    , liveAudio(AUDIO_QUEUE_CAPACITY)
+    , audioFrames(0)
+    , midiAudio(MidiInput::QUEUE_CAPACITY)
+    , pendingInputCount(0)
+    , pendingInputSumNs(0)
+    , pendingInputOldestNs(0)
+    , inputLatencyCount(0)
+    , inputLatencyTotalNs(0)
+    , inputLatencyMaxNs(0)
+    , songDuration(0)
+    , overlapPolicy(NotePairing::FIRST_IN_FIRST_OUT)
     , playing(false)
     , paused(false)
-    , startTime(0)
-    , currentTime(0)
-    , playbackSpeed(1.0f)
-    , scrollSpeed(200.0f)
+    , clockTime(0)
+    , songTime(0)
+    , scrollSpeed(DEFAULT_SCROLL_SPEED)
+    , running(false)
     , showHelp(false)
+    , showProfiler(false)
+    , printFrameStats(false)
+    , scrubbing(false)
+    , scrubMoved(false)
+    , scrubPosition(0.0f)
 {
 }
 
@@ -43,8 +115,12 @@ bool WaterfallPiano::initialize() {
         return false;
     }
     
-    // Create renderer
+    // Create renderer; fall back to software, e.g. under the dummy video
+    // driver used by the headless benchmarks
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!renderer) {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
     if (!renderer) {
         std::cerr << "Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
         return false;
@@ -55,297 +131,835 @@ bool WaterfallPiano::initialize() {
     // Initialize piano keys
     initializeKeys();
     
-    // Initialize waterfall texture
-    initializeWaterfallTexture();
+    // Initialize the cached background and keyboard layers
+    initializeLayerTextures();
+    
+    // Sound is optional; the piano still works silently without it
+    if (!initializeAudio()) {
+        std::cerr << "Audio unavailable, continuing without sound: " << SDL_GetError() << std::endl;
+    }
     
     running = true;
     return true;
 }
 
 void WaterfallPiano::initializeKeys() {
-    keys.clear();
+    keys = PianoLayout::createKeys();
+    
     keyMap.clear();
+    for (size_t i = 0; i < keys.size(); i++) {
+        keyMap[keys[i].midiNote] = static_cast<int>(i);
+    }
+}
+
+bool WaterfallPiano::initializeAudio() {
+    SDL_AudioSpec desired = {};
+    desired.freq = 48000;
+    desired.format = AUDIO_F32SYS;
+    desired.channels = 2;
+    desired.samples = 512;
+    desired.callback = audioCallback;
+    desired.userdata = this;
+    
+    SDL_AudioSpec obtained = {};
+    audioDevice = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained,
+                                      SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (audioDevice == 0) {
+        return false;
+    }
+    
+    // The synthesizer allocates everything here, before the callback runs
+    synth.setSampleRate(obtained.freq, obtained.samples);
+    audioSampleRate = obtained.freq;
+    audioLatencyFrames = static_cast<uint64_t>(obtained.freq) * AUDIO_SCHEDULE_AHEAD_MS / 1000 +
+                         obtained.samples;
+    SDL_PauseAudioDevice(audioDevice, 0);
     
-    int whiteKeyCount = 0;
+    std::cout << "Audio: " << obtained.freq << " Hz, " << obtained.samples << " sample buffer, "
+              << Synthesizer::MAX_VOICES << " voices" << std::endl;
+    return true;
+}
+
+void WaterfallPiano::audioCallback(void* userdata, Uint8* stream, int length) {
+    WaterfallPiano* piano = static_cast<WaterfallPiano*>(userdata);
+    
+    // Channel changes are not allowed when opening, so the stream is
+    // always stereo
+    int frames = length / static_cast<int>(sizeof(float) * 2);
+    piano->renderAudio(reinterpret_cast<float*>(stream), frames);
+}
+
+void WaterfallPiano::renderAudio(float* output, int frames) {
+    const int channels = 2;
+    uint64_t blockStart = audioFrames.load(std::memory_order_relaxed);
+    uint64_t blockEnd = blockStart + frames;
     
-    for (int i = 0; i < TOTAL_KEYS; i++) {
-        int midiNote = FIRST_MIDI_NOTE + i;
-        PianoKey key;
-        key.midiNote = midiNote;
-        key.isBlack = isBlackKey(midiNote);
-        key.pressed = false;
+    // The playback clock follows the device through these samples
+    AudioClockSample& sample = audioClock.getWriteBuffer();
+    sample.frame = blockStart;
+    sample.stampUs = PlaybackClock::steadyNow();
+    sample.frames = frames;
+    audioClock.publish();
+    
+    // Live input is played at the very start of the block
+    while (!liveAudio.empty()) {
+        applyAudioEvent(synth, liveAudio.front());
+        liveAudio.pop();
+    }
+    while (!midiAudio.empty()) {
+        applyAudioEvent(synth, midiAudio.front());
+        midiAudio.pop();
+    }
+    
+    // Scheduled events split the block at their sample offsets. Late
+    // events (and ones queued out of order) play at the current position
+    int rendered = 0;
+    while (!scheduledAudio.empty()) {
+        const AudioEvent& event = scheduledAudio.front();
+        if (event.frame >= blockEnd) break;
         
-        if (!key.isBlack) {
-            key.whiteKeyIndex = whiteKeyCount;
-            whiteKeyCount++;
+        int offset = event.frame > blockStart ? static_cast<int>(event.frame - blockStart) : 0;
+        if (offset > rendered) {
+            synth.render(output + static_cast<size_t>(rendered) * channels, offset - rendered, channels);
+            rendered = offset;
         }
         
-        keys.push_back(key);
-        keyMap[midiNote] = i;
+        applyAudioEvent(synth, event);
+        scheduledAudio.pop();
     }
     
-    // Position white keys
-    for (auto& key : keys) {
-        if (!key.isBlack) {
-            key.rect.x = key.whiteKeyIndex * WHITE_KEY_WIDTH;
-            key.rect.y = WATERFALL_HEIGHT;
-            key.rect.w = WHITE_KEY_WIDTH - 2;
-            key.rect.h = WHITE_KEY_HEIGHT;
-        }
-    }
+    synth.render(output + static_cast<size_t>(rendered) * channels, frames - rendered, channels);
+    audioFrames.store(blockEnd, std::memory_order_release);
+}
+
+void WaterfallPiano::queueAudioEvent(AudioEventQueue& queue, AudioEvent::Type type,
+                                     int note, int velocity, uint64_t frame) {
+    // Without an audio device nothing would ever drain the queue
+    if (!audioDevice) return;
     
-    // Position black keys (on top of white keys)
-    for (size_t i = 0; i < keys.size(); i++) {
-        if (keys[i].isBlack && i > 0) {
-            // Find adjacent white key
-            int whiteIdx = keys[i-1].whiteKeyIndex;
-            keys[i].rect.x = whiteIdx * WHITE_KEY_WIDTH + WHITE_KEY_WIDTH - BLACK_KEY_WIDTH / 2;
-            keys[i].rect.y = WATERFALL_HEIGHT;
-            keys[i].rect.w = BLACK_KEY_WIDTH;
-            keys[i].rect.h = BLACK_KEY_HEIGHT;
+    AudioEvent event;
+    event.frame = frame;
+    event.type = type;
+    event.note = static_cast<uint8_t>(note);
+    event.velocity = static_cast<uint8_t>(std::max(0, std::min(velocity, 127)));
+    queue.push(event);
+}
+
+bool WaterfallPiano::openMidiInput(const std::string& source) {
+    // Without a sound device live notes only light up the keys
+    return midiInput.open(source, audioDevice ? &midiAudio : nullptr);
+}
+
+void WaterfallPiano::pollMidiInput() {
+    SpscQueue<MidiInputEvent>& events = midiInput.getEvents();
+    while (!events.empty()) {
+        const MidiInputEvent& event = events.front();
+        if (setKeyPressed(liveKeys, event.note, event.velocity > 0)) {
+            if (pendingInputCount == 0) pendingInputOldestNs = event.receivedNs;
+            pendingInputCount++;
+            pendingInputSumNs += event.receivedNs;
         }
+        events.pop();
     }
 }
 
-void WaterfallPiano::initializeWaterfallTexture() {
+void WaterfallPiano::recordInputLatency() {
+    if (pendingInputCount == 0) return;
+    
+    // The oldest pending change waited longest; the average needs only
+    // the sum of the receipt times
+    uint64_t presented = MidiInput::now();
+    inputLatencyTotalNs += presented * pendingInputCount - pendingInputSumNs;
+    inputLatencyMaxNs = std::max(inputLatencyMaxNs, presented - pendingInputOldestNs);
+    inputLatencyCount += pendingInputCount;
+    pendingInputCount = 0;
+    pendingInputSumNs = 0;
+}
+
+void WaterfallPiano::initializeLayerTextures() {
     waterfallTexture = SDL_CreateTexture(renderer,
                                          SDL_PIXELFORMAT_RGBA8888,
                                          SDL_TEXTUREACCESS_TARGET,
                                          SCREEN_WIDTH,
                                          WATERFALL_HEIGHT);
+    keyboardTexture = SDL_CreateTexture(renderer,
+                                        SDL_PIXELFORMAT_RGBA8888,
+                                        SDL_TEXTUREACCESS_TARGET,
+                                        SCREEN_WIDTH,
+                                        KEYBOARD_HEIGHT);
     
+    // Without render targets every layer is drawn each frame instead
+    if (!waterfallTexture || !keyboardTexture) {
+        std::cerr << "Render targets unavailable, drawing every layer each frame" << std::endl;
+        destroyLayerTextures();
+        return;
+    }
+    
+    // Both layers are opaque, so copying them needs no blending
+    SDL_SetTextureBlendMode(waterfallTexture, SDL_BLENDMODE_NONE);
+    SDL_SetTextureBlendMode(keyboardTexture, SDL_BLENDMODE_NONE);
+    layersDirty = true;
+    
+    // Notes are blended over the background when the ring is copied
+    noteRingTexture = SDL_CreateTexture(renderer,
+                                        SDL_PIXELFORMAT_RGBA8888,
+                                        SDL_TEXTUREACCESS_TARGET,
+                                        SCREEN_WIDTH,
+                                        WATERFALL_HEIGHT);
+    if (noteRingTexture) {
+        SDL_SetTextureBlendMode(noteRingTexture, SDL_BLENDMODE_BLEND);
+    }
+    noteRingValid = false;
+}
+
+void WaterfallPiano::destroyLayerTextures() {
     if (waterfallTexture) {
-        SDL_SetTextureBlendMode(waterfallTexture, SDL_BLENDMODE_BLEND);
+        SDL_DestroyTexture(waterfallTexture);
+        waterfallTexture = nullptr;
+    }
+    
+    if (keyboardTexture) {
+        SDL_DestroyTexture(keyboardTexture);
+        keyboardTexture = nullptr;
+    }
+    
+    if (noteRingTexture) {
+        SDL_DestroyTexture(noteRingTexture);
+        noteRingTexture = nullptr;
     }
 }
 
-bool WaterfallPiano::isBlackKey(int midiNote) {
-    int noteInOctave = midiNote % 12;
-    return (noteInOctave == 1 || noteInOctave == 3 || noteInOctave == 6 || 
-            noteInOctave == 8 || noteInOctave == 10);
+int64_t WaterfallPiano::timeToScrollPixel(uint32_t time) const {
+    return static_cast<int64_t>(std::floor(time * static_cast<double>(scrollSpeed) / 1000.0));
 }
 
-int WaterfallPiano::getWhiteKeyIndex(int midiNote) {
-    int whiteKeyCount = 0;
-    for (int i = FIRST_MIDI_NOTE; i <= midiNote; i++) {
-        if (!isBlackKey(i)) {
-            if (i == midiNote) return whiteKeyCount;
-            whiteKeyCount++;
-        }
+void WaterfallPiano::getStripTimes(int64_t from, int64_t to, uint32_t& fromTime, uint32_t& toTime) const {
+    // Pixel p starts at time p / pixels per ms; widen by a millisecond so
+    // rounding never drops a note at the edge of the strip
+    double msPerPixel = 1000.0 / scrollSpeed;
+    fromTime = static_cast<uint32_t>(std::max(0.0, from * msPerPixel - 1.0));
+    toTime = static_cast<uint32_t>(std::min(4294967295.0, to * msPerPixel + 1.0));
+}
+
+void WaterfallPiano::updateNoteRing() {
+    ProfileScope scope("updateNoteRing");
+    
+    // Scroll pixel p (time * pixels per ms) lives in ring row
+    // H - 1 - p mod H, so later times sit higher up like on screen
+    int64_t bottom = timeToScrollPixel(snapshots.read().songTime);
+    int64_t top = bottom + WATERFALL_HEIGHT;
+    
+    // After a seek or a backwards jump nothing in the ring is reusable
+    int64_t from = noteRingTop;
+    if (!noteRingValid || from > top || from < bottom) {
+        from = bottom;
+    }
+    if (from == top) return;
+    
+    // Strips are kept once drawn, so they must come from a note window
+    // that holds all of their notes; until one arrives (e.g. right after
+    // a seek) the notes are drawn in full each frame
+    uint32_t fromTime, toTime;
+    getStripTimes(from, top, fromTime, toTime);
+    if (!noteWindows.read().covers(fromTime, toTime)) {
+        noteRingValid = false;
+        return;
+    }
+    
+    SDL_SetRenderTarget(renderer, noteRingTexture);
+    
+    // Draw the notes unblended; blending happens once, when the ring is copied
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    
+    // Split the exposed strip where it wraps around the ring
+    while (from < top) {
+        int64_t blockEnd = (from / WATERFALL_HEIGHT + 1) * WATERFALL_HEIGHT;
+        int64_t to = std::min(top, blockEnd);
+        drawNoteRingStrip(from, to);
+        from = to;
     }
-    return whiteKeyCount;
+    frameDrawCalls += batch.flush(renderer);
+    
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderTarget(renderer, nullptr);
+    
+    noteRingTop = top;
+    noteRingValid = true;
+}
+
+void WaterfallPiano::drawNoteRingStrip(int64_t from, int64_t to) {
+    // Ring rows for scroll pixels [from, to), which do not wrap
+    auto ringRow = [](int64_t pixel) {
+        return WATERFALL_HEIGHT - 1 - static_cast<int>(pixel % WATERFALL_HEIGHT);
+    };
+    
+    SDL_Color transparent = {0, 0, 0, 0};
+    drawFilledRect({0, ringRow(to - 1), SCREEN_WIDTH, static_cast<int>(to - from)}, transparent);
+    batch.nextLayer();
+    
+    auto drawNote = [&](const NoteInterval& note) {
+        auto it = keyMap.find(note.key);
+        if (it == keyMap.end()) return;
+        
+        const PianoKey& key = keys[it->second];
+        
+        // Every note covers at least one pixel, like in the full redraw
+        int64_t noteStart = timeToScrollPixel(note.start);
+        int64_t noteEnd = std::max(noteStart + 1, timeToScrollPixel(note.end));
+        int64_t clipStart = std::max(noteStart, from);
+        int64_t clipEnd = std::min(noteEnd, to);
+        if (clipStart >= clipEnd) return;
+        
+        SDL_Rect noteRect;
+        noteRect.x = key.rect.x + 2;
+        noteRect.y = ringRow(clipEnd - 1);
+        noteRect.w = key.rect.w - 4;
+        noteRect.h = static_cast<int>(clipEnd - clipStart);
+        
+        drawFilledRect(noteRect, getNoteColor(note.velocity));
+    };
+    
+    uint32_t fromTime, toTime;
+    getStripTimes(from, to, fromTime, toTime);
+    noteWindows.read().forEachInRange(fromTime, toTime, drawNote);
+    batch.nextLayer();
+}
+
+void WaterfallPiano::renderLayerTextures() {
+    SDL_SetRenderTarget(renderer, waterfallTexture);
+    SDL_SetRenderDrawColor(renderer, 
+                          COLOR_BACKGROUND.r, COLOR_BACKGROUND.g, 
+                          COLOR_BACKGROUND.b, COLOR_BACKGROUND.a);
+    SDL_RenderClear(renderer);
+    drawWaterfallBackground();
+    frameDrawCalls += batch.flush(renderer);
+    
+    // Key rectangles are in screen coordinates; the layer starts at the
+    // keyboard. The flush above may have left a guide line color set
+    SDL_SetRenderTarget(renderer, keyboardTexture);
+    SDL_SetRenderDrawColor(renderer,
+                          COLOR_BACKGROUND.r, COLOR_BACKGROUND.g,
+                          COLOR_BACKGROUND.b, COLOR_BACKGROUND.a);
+    SDL_RenderClear(renderer);
+    drawKeyboard(-WATERFALL_HEIGHT, false);
+    frameDrawCalls += batch.flush(renderer);
+    
+    SDL_SetRenderTarget(renderer, nullptr);
+    layersDirty = false;
 }
 
 bool WaterfallPiano::loadMidiFile(const std::string& filename) {
-    MidiParser parser;
+    // Huge files are decoded incrementally during playback
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (file.is_open() && static_cast<size_t>(file.tellg()) >= STREAMING_MIN_FILE_SIZE) {
+        return loadMidiStream(filename);
+    }
     
-    if (!parser.loadFile(filename)) {
-        std::cerr << "Failed to load MIDI file: " << filename << std::endl;
+    if (!SongCache::loadTimeline(filename, timeline, overlapPolicy)) {
         return false;
     }
     
     currentMidiFile = filename;
-    midiEvents.clear();
-    upcomingNotes.clear();
+    stream.reset();
+    noteRingValid = false;
     
-    // Convert MIDI notes to events
-    std::vector<MidiNote> allNotes = parser.getAllNotes();
+    songDuration = timeline.getDuration();
+    scheduler.reset(&timeline);
+    seekIndex.build(timeline);
     
-    for (const auto& note : allNotes) {
-        MidiEvent event;
-        event.time = note.time;
-        event.note = note.note;
-        event.velocity = note.velocity;
-        event.isNoteOn = note.isNoteOn;
-        midiEvents.push_back(event);
+    std::cout << "Loaded MIDI file: " << filename << std::endl;
+    std::cout << "Total notes: " << timeline.size() << std::endl;
+    
+    return true;
+}
+
+bool WaterfallPiano::loadMidiStream(const std::string& filename) {
+    std::unique_ptr<StreamingTimeline> newStream(new StreamingTimeline());
+    
+    newStream->setOverlapPolicy(overlapPolicy);
+    if (!newStream->open(filename)) {
+        std::cerr << "Failed to load MIDI file: " << filename << std::endl;
+        return false;
     }
     
-    // Sort events by time
-    std::sort(midiEvents.begin(), midiEvents.end(),
-              [](const MidiEvent& a, const MidiEvent& b) { return a.time < b.time; });
+    currentMidiFile = filename;
+    stream = std::move(newStream);
+    timeline.clear();
+    seekIndex.clear();
+    songDuration = 0;
+    noteRingValid = false;
     
-    std::cout << "Loaded MIDI file: " << filename << std::endl;
-    std::cout << "Total events: " << midiEvents.size() << std::endl;
+    // Only the first screen of notes is decoded before playback can start
+    stream->fill(getLookAhead() + NOTE_WINDOW_MARGIN_MS);
+    scheduler.reset(&stream->getEvents());
+    
+    std::cout << "Streaming MIDI file: " << filename << std::endl;
+    std::cout << "File size: " << stream->getFileSize() / (1024 * 1024) << " MB" << std::endl;
     
     return true;
 }
 
+Uint32 WaterfallPiano::getLookAhead() const {
+    return static_cast<Uint32>(WATERFALL_HEIGHT / scrollSpeed * 1000);
+}
+
 void WaterfallPiano::playMidi() {
-    if (midiEvents.empty()) {
+    if (timeline.empty() && !stream) {
         std::cout << "No MIDI file loaded!" << std::endl;
         return;
     }
     
+    // Start where the clock stands: the beginning after a stop, or wherever
+    // the song was scrubbed to while stopped. A loaded song scrubbed to its
+    // end starts over
+    Uint32 start = static_cast<Uint32>(playbackClock.getPosition(clockTime) / 1000);
+    if (!stream && start >= songDuration) {
+        start = 0;
+    }
+    
     playing = true;
     paused = false;
-    startTime = SDL_GetTicks();
+    songTime = start;
+    playbackClock.seek(static_cast<int64_t>(start) * 1000, clockTime);
+    playbackClock.resume(clockTime);
+    
+    // Notes held at the start sound from the first frame
+    seekPlayback(start, true);
 }
 
 void WaterfallPiano::pauseMidi() {
     paused = !paused;
+    
+    // Held notes fall silent while paused; the clock does not count the pause
+    if (paused) {
+        playbackClock.pause(clockTime);
+        queueAudioEvent(scheduledAudio, AudioEvent::ALL_NOTES_OFF, 0, 0, 0);
+    } else {
+        playbackClock.resume(clockTime);
+    }
 }
 
 void WaterfallPiano::stopMidi() {
     playing = false;
     paused = false;
-    currentTime = 0;
-    activeNotes.clear();
+    songTime = 0;
+    playbackClock.pause(clockTime);
+    playbackClock.seek(0, clockTime);
     
-    // Release all keys
-    for (auto& key : keys) {
-        key.pressed = false;
-    }
+    seekPlayback(0, false);
 }
 
-SDL_Color WaterfallPiano::getNoteColor(int velocity) {
-    // Color gradient based on velocity
-    float normalizedVel = velocity / 127.0f;
-    
-    SDL_Color color;
-    if (normalizedVel < 0.33f) {
-        // Blue to cyan
-        color = {100, 150, 255, 200};
-    } else if (normalizedVel < 0.66f) {
-        // Cyan to green
-        color = {100, 255, 150, 200};
+void WaterfallPiano::setMidiPosition(float position, bool resumeNotes) {
+    if (timeline.empty() && !stream) return;
+    
+    position = std::max(0.0f, std::min(position, 1.0f));
+    
+    // The length of a streamed song is unknown, so its position is
+    // measured by how much of the file has been decoded
+    Uint32 target;
+    if (stream) {
+        target = stream->skipToProgress(position);
     } else {
-        // Green to yellow
-        color = {255, 220, 100, 200};
+        target = static_cast<Uint32>(position * songDuration);
     }
     
-    return color;
+    // Playback continues from the target position at the current speed
+    playbackClock.seek(static_cast<int64_t>(target) * 1000, clockTime);
+    songTime = target;
+    
+    seekPlayback(target, resumeNotes);
 }
 
-void WaterfallPiano::updateWaterfall(float deltaTime) {
-    if (!playing || paused) return;
+void WaterfallPiano::seekPlayback(Uint32 time, bool resumeNotes) {
+    // Keys pressed before the jump no longer apply
+    releaseAllKeys();
     
-    currentTime = SDL_GetTicks() - startTime;
+    // Find the keys held at the target: a loaded song restores them from
+    // the nearest keyframe; a streamed window still holds every note that
+    // sounds at the target
+    KeyVelocities held;
+    if (stream) {
+        stream->skipTo(time);
+        stream->fill(time + getLookAhead() + NOTE_WINDOW_MARGIN_MS);
+        scheduler.reset(&stream->getEvents());
+        scheduler.seek(time);
+        
+        held.fill(0);
+        stream->forEachInRange(time, time, [&](const NoteInterval& note) {
+            if (note.start < time) {
+                held[note.key & 127] = note.velocity;
+            }
+        });
+    } else {
+        seekIndex.seek(scheduler, time, held);
+    }
     
-    // Process MIDI events
-    for (auto& event : midiEvents) {
-        if (event.time <= currentTime * playbackSpeed) {
-            if (event.isNoteOn && event.velocity > 0) {
-                // Note on
-                handleKeyPress(event.note);
-                
-                Note note;
-                note.midiNote = event.note;
-                note.startTime = currentTime;
-                note.endTime = 0;
-                note.velocity = event.velocity;
-                note.active = true;
-                note.color = getNoteColor(event.velocity);
-                activeNotes.push_back(note);
-            } else {
-                // Note off
-                handleKeyRelease(event.note);
-                
-                // Find and end the active note
-                for (auto& note : activeNotes) {
-                    if (note.active && note.midiNote == event.note) {
-                        note.endTime = currentTime;
-                        note.active = false;
-                        break;
-                    }
+    // While scrubbing the keys are only shown; otherwise the held notes
+    // sound again from the target, behind the reset above
+    uint64_t audioNow = audioFrames.load(std::memory_order_acquire) + audioLatencyFrames;
+    resumeNotes = resumeNotes && playing && !paused;
+    for (int note = 0; note < 128; note++) {
+        if (held[note] == 0 || !setKeyPressed(playbackKeys, note, true)) continue;
+        if (resumeNotes) {
+            queueAudioEvent(scheduledAudio, AudioEvent::NOTE_ON, note, held[note], audioNow);
+        }
+    }
+}
+
+void WaterfallPiano::releaseAllKeys() {
+    playbackKeys.reset();
+    
+    // Queued behind the scheduled notes, so none of them outlives the reset
+    queueAudioEvent(scheduledAudio, AudioEvent::ALL_NOTES_OFF, 0, 0, 0);
+}
+
+SDL_Color WaterfallPiano::getNoteColor(int velocity) {
+    return PianoLayout::getNoteColor(velocity);
+}
+
+void WaterfallPiano::sendPlaybackCommand(PlaybackCommand::Type type, float value) {
+    PlaybackCommand command;
+    command.type = type;
+    command.value = value;
+    playbackCommands.push(command);
+}
+
+void WaterfallPiano::applyPlaybackCommands() {
+    while (!playbackCommands.empty()) {
+        PlaybackCommand command = playbackCommands.front();
+        playbackCommands.pop();
+        
+        switch (command.type) {
+            case PlaybackCommand::TOGGLE_PLAYBACK:
+                if (playing) pauseMidi();
+                else playMidi();
+                break;
+            case PlaybackCommand::STOP:
+                stopMidi();
+                break;
+            case PlaybackCommand::SEEK:
+            case PlaybackCommand::SCRUB: {
+                // Only the newest of several queued positions matters, but
+                // held notes sound again if any of them was a seek
+                bool resumeNotes = command.type == PlaybackCommand::SEEK;
+                while (!playbackCommands.empty() && isSeekCommand(playbackCommands.front())) {
+                    command = playbackCommands.front();
+                    playbackCommands.pop();
+                    resumeNotes = resumeNotes || command.type == PlaybackCommand::SEEK;
                 }
+                setMidiPosition(command.value, resumeNotes);
+                break;
             }
+            case PlaybackCommand::CHANGE_SPEED:
+                playbackClock.setSpeed(std::max(0.1, std::min(playbackClock.getSpeed() + command.value, 3.0)),
+                                       clockTime);
+                break;
         }
     }
+}
+
+void WaterfallPiano::startSimulation() {
+    if (simulationThread.joinable()) return;
+    
+    simulationRunning.store(true, std::memory_order_release);
+    simulationThread = std::thread(&WaterfallPiano::runSimulation, this);
+}
+
+void WaterfallPiano::stopSimulation() {
+    if (!simulationThread.joinable()) return;
     
-    // Remove old notes that have scrolled off screen
-    activeNotes.erase(
-        std::remove_if(activeNotes.begin(), activeNotes.end(),
-                      [this](const Note& note) {
-                          return !note.active && 
-                                 (currentTime - note.endTime) > (WATERFALL_HEIGHT / scrollSpeed * 1000);
-                      }),
-        activeNotes.end()
-    );
+    simulationRunning.store(false, std::memory_order_release);
+    simulationThread.join();
 }
 
-void WaterfallPiano::handleKeyPress(int midiNote) {
-    if (midiNote < FIRST_MIDI_NOTE || midiNote > LAST_MIDI_NOTE) return;
+void WaterfallPiano::runSimulation() {
+    Profiler::shared().setThreadName("simulation");
+    
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration step = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / SIMULATION_RATE));
+    Clock::time_point deadline = Clock::now();
     
-    auto it = keyMap.find(midiNote);
-    if (it != keyMap.end()) {
-        keys[it->second].pressed = true;
+    while (simulationRunning.load(std::memory_order_acquire)) {
+        clockTime = std::max(clockTime, readReferenceClock());
+        applyPlaybackCommands();
+        if (playing && !paused) {
+            updatePlayback();
+        }
+        publishSnapshots();
+        
+        // Steps are due at fixed deadlines, so the rate does not drift.
+        // After a stall the missed steps are not replayed: the next update
+        // dispatches everything that became due, stamped by its lateness
+        deadline += step;
+        Clock::time_point now = Clock::now();
+        if (deadline < now) {
+            deadline = now;
+        }
+        std::this_thread::sleep_until(deadline);
     }
 }
 
-void WaterfallPiano::handleKeyRelease(int midiNote) {
-    if (midiNote < FIRST_MIDI_NOTE || midiNote > LAST_MIDI_NOTE) return;
+void WaterfallPiano::publishSnapshots() {
+    FrameSnapshot& frame = snapshots.getWriteBuffer();
+    frame.songTime = songTime;
+    if (stream) {
+        frame.progress = stream->getProgress();
+    } else {
+        frame.progress = songDuration > 0 ? std::min(1.0f, static_cast<float>(songTime) / songDuration) : 0.0f;
+    }
+    frame.playing = playing;
+    frame.paused = paused;
+    frame.keys = playbackKeys;
+    snapshots.publish();
     
-    auto it = keyMap.find(midiNote);
-    if (it != keyMap.end()) {
-        keys[it->second].pressed = false;
+    // Copying the visible notes costs more, so a new window is only taken
+    // once the last one was picked up, or when it no longer covers the view
+    Uint32 lookAhead = getLookAhead();
+    if (noteWindows.hasUnread() && publishedWindow.covers(songTime, songTime + lookAhead)) {
+        return;
+    }
+    
+    NoteWindow& window = noteWindows.getWriteBuffer();
+    window.reset(songTime > NOTE_WINDOW_MARGIN_MS ? songTime - NOTE_WINDOW_MARGIN_MS : 0,
+                 songTime + lookAhead + NOTE_WINDOW_MARGIN_MS);
+    
+    auto copyNote = [&](const NoteInterval& note) {
+        window.notes.push_back(note);
+    };
+    if (stream) {
+        stream->forEachInRange(window.from, window.to, copyNote);
+    } else {
+        timeline.forEachInRange(window.from, window.to, copyNote);
+    }
+    
+    publishedWindow.from = window.from;
+    publishedWindow.to = window.to;
+    noteWindows.publish();
+}
+
+int64_t WaterfallPiano::readReferenceClock() {
+    int64_t now = PlaybackClock::steadyNow();
+    if (!audioDevice) return now;
+    
+    // Follow the sound card, which the scheduled notes are stamped against
+    audioClock.update();
+    return PlaybackClock::audioNow(audioClock.read(), audioSampleRate, now);
+}
+
+void WaterfallPiano::updatePlayback() {
+    ProfileScope scope("updatePlayback");
+    
+    // Every seek also repositions the scheduler, so the position only
+    // moves forward here
+    int64_t position = playbackClock.getPosition(clockTime);
+    songTime = static_cast<Uint32>(position / 1000);
+    
+    // Keep the streamed window decoded up to the end of the note window
+    if (stream) {
+        stream->fill(songTime + getLookAhead() + NOTE_WINDOW_MARGIN_MS);
+    }
+    
+    // Dispatch only the events that became due since the last frame. Each
+    // is stamped relative to the audio clock by how long ago it became due,
+    // so the callback reproduces the spacing between events
+    uint64_t audioNow = audioFrames.load(std::memory_order_acquire) + audioLatencyFrames;
+    double framesPerSongUs = audioSampleRate / (1000000.0 * playbackClock.getSpeed());
+    scheduler.advance(songTime, [&](const MidiEvent& event) {
+        int64_t lateUs = position - static_cast<int64_t>(event.time) * 1000;
+        uint64_t late = static_cast<uint64_t>(lateUs * framesPerSongUs);
+        dispatchEvent(event, late < audioNow ? audioNow - late : 0);
+    });
+    
+    // Streamed events and notes that are done are not needed any more
+    if (stream) {
+        stream->discardEvents(scheduler.getCursor());
+        scheduler.rebase(scheduler.getCursor());
+        stream->trimNotes(songTime);
+    }
+}
+
+void WaterfallPiano::dispatchEvent(const MidiEvent& event, uint64_t audioFrame) {
+    bool pressed = event.isNoteOn && event.velocity > 0;
+    if (!setKeyPressed(playbackKeys, event.note, pressed)) return;
+    
+    if (pressed) {
+        queueAudioEvent(scheduledAudio, AudioEvent::NOTE_ON, event.note, event.velocity, audioFrame);
+    } else {
+        queueAudioEvent(scheduledAudio, AudioEvent::NOTE_OFF, event.note, 0, audioFrame);
+    }
+}
+
+bool WaterfallPiano::setKeyPressed(KeyStates& states, int midiNote, bool pressed) {
+    if (midiNote < FIRST_MIDI_NOTE || midiNote > LAST_MIDI_NOTE) return false;
+    
+    states.set(midiNote, pressed);
+    return true;
+}
+
+void WaterfallPiano::handleKeyPress(int midiNote, int velocity) {
+    if (setKeyPressed(liveKeys, midiNote, true)) {
+        queueAudioEvent(liveAudio, AudioEvent::NOTE_ON, midiNote, velocity, 0);
+    }
+}
+
+void WaterfallPiano::handleKeyRelease(int midiNote) {
+    if (setKeyPressed(liveKeys, midiNote, false)) {
+        queueAudioEvent(liveAudio, AudioEvent::NOTE_OFF, midiNote, 0, 0);
     }
 }
 
 void WaterfallPiano::renderKeyboard() {
+    ProfileScope scope("renderKeyboard");
+    
+    if (!keyboardTexture) {
+        drawKeyboard(0, true);
+        return;
+    }
+    
+    // The cached layer shows every key released; only pressed keys are drawn over it
+    SDL_Rect keyboardArea = {0, WATERFALL_HEIGHT, SCREEN_WIDTH, KEYBOARD_HEIGHT};
+    SDL_RenderCopy(renderer, keyboardTexture, nullptr, &keyboardArea);
+    frameDrawCalls++;
+    drawPressedKeys();
+}
+
+void WaterfallPiano::drawKeyboard(int offsetY, bool showPressed) {
     // Draw white keys first
     for (const auto& key : keys) {
         if (!key.isBlack) {
-            SDL_Color color = key.pressed ? COLOR_WHITE_PRESSED : COLOR_WHITE_KEY;
-            drawFilledRect(key.rect, color);
-            drawRect(key.rect, COLOR_BLACK_KEY);
+            SDL_Rect rect = {key.rect.x, key.rect.y + offsetY, key.rect.w, key.rect.h};
+            bool pressed = showPressed && key.pressed;
+            drawFilledRect(rect, pressed ? COLOR_WHITE_PRESSED : COLOR_WHITE_KEY);
+        }
+    }
+    batch.nextLayer();
+    
+    for (const auto& key : keys) {
+        if (!key.isBlack) {
+            SDL_Rect rect = {key.rect.x, key.rect.y + offsetY, key.rect.w, key.rect.h};
+            drawRect(rect, COLOR_BLACK_KEY);
         }
     }
+    batch.nextLayer();
     
     // Draw black keys on top
     for (const auto& key : keys) {
         if (key.isBlack) {
-            SDL_Color color = key.pressed ? COLOR_BLACK_PRESSED : COLOR_BLACK_KEY;
-            drawFilledRect(key.rect, color);
+            SDL_Rect rect = {key.rect.x, key.rect.y + offsetY, key.rect.w, key.rect.h};
+            bool pressed = showPressed && key.pressed;
+            drawFilledRect(rect, pressed ? COLOR_BLACK_PRESSED : COLOR_BLACK_KEY);
         }
     }
+    batch.nextLayer();
 }
 
-void WaterfallPiano::renderWaterfall() {
-    // Clear waterfall area
+void WaterfallPiano::drawPressedKeys() {
+    for (const auto& key : keys) {
+        if (!key.isBlack && key.pressed) {
+            drawFilledRect(key.rect, COLOR_WHITE_PRESSED);
+        }
+    }
+    batch.nextLayer();
+    
+    for (const auto& key : keys) {
+        if (!key.isBlack && key.pressed) {
+            drawRect(key.rect, COLOR_BLACK_KEY);
+        }
+    }
+    batch.nextLayer();
+    
+    // A pressed white key is drawn over its black neighbours, so they are
+    // restored even when they are not pressed themselves
+    for (size_t i = 0; i < keys.size(); i++) {
+        const PianoKey& key = keys[i];
+        if (!key.isBlack) continue;
+        
+        bool neighbourPressed = (i > 0 && keys[i-1].pressed) ||
+                                (i + 1 < keys.size() && keys[i+1].pressed);
+        if (key.pressed) {
+            drawFilledRect(key.rect, COLOR_BLACK_PRESSED);
+        } else if (neighbourPressed) {
+            drawFilledRect(key.rect, COLOR_BLACK_KEY);
+        }
+    }
+    batch.nextLayer();
+}
+
+void WaterfallPiano::drawWaterfallBackground() {
     SDL_Rect waterfallArea = {0, 0, SCREEN_WIDTH, WATERFALL_HEIGHT};
-    SDL_SetRenderDrawColor(renderer, 
-                          COLOR_BACKGROUND.r, COLOR_BACKGROUND.g, 
-                          COLOR_BACKGROUND.b, COLOR_BACKGROUND.a);
-    SDL_RenderFillRect(renderer, &waterfallArea);
+    drawFilledRect(waterfallArea, COLOR_BACKGROUND);
+    batch.nextLayer();
     
     // Draw guide lines for keys
-    SDL_SetRenderDrawColor(renderer, 40, 40, 50, 50);
     for (const auto& key : keys) {
         if (!key.isBlack) {
             int x = key.rect.x + key.rect.w / 2;
-            SDL_RenderDrawLine(renderer, x, 0, x, WATERFALL_HEIGHT);
+            drawFilledRect({x, 0, 1, WATERFALL_HEIGHT}, COLOR_GUIDE_LINE);
         }
     }
+    batch.nextLayer();
+}
+
+void WaterfallPiano::renderWaterfall() {
+    ProfileScope scope("renderWaterfall");
+    Uint32 songTime = snapshots.read().songTime;
+    
+    // Background and guide lines come from the cached layer when available
+    if (waterfallTexture) {
+        SDL_Rect waterfallArea = {0, 0, SCREEN_WIDTH, WATERFALL_HEIGHT};
+        SDL_RenderCopy(renderer, waterfallTexture, nullptr, &waterfallArea);
+        frameDrawCalls++;
+    } else {
+        drawWaterfallBackground();
+    }
+    
+    // Incremental mode: copy the ring in two parts so that its row for
+    // the current time lands at the bottom of the waterfall
+    if (incrementalWaterfall && noteRingTexture && noteRingValid) {
+        int shift = static_cast<int>(timeToScrollPixel(songTime) % WATERFALL_HEIGHT);
+        if (shift > 0) {
+            SDL_Rect source = {0, WATERFALL_HEIGHT - shift, SCREEN_WIDTH, shift};
+            SDL_Rect target = {0, 0, SCREEN_WIDTH, shift};
+            SDL_RenderCopy(renderer, noteRingTexture, &source, &target);
+            frameDrawCalls++;
+        }
+        SDL_Rect source = {0, 0, SCREEN_WIDTH, WATERFALL_HEIGHT - shift};
+        SDL_Rect target = {0, shift, SCREEN_WIDTH, WATERFALL_HEIGHT - shift};
+        SDL_RenderCopy(renderer, noteRingTexture, &source, &target);
+        frameDrawCalls++;
+        return;
+    }
+    
+    // Draw falling notes: the window spans from now (bottom, at the keys)
+    // to the look-ahead time at the top of the screen
+    Uint32 lookAhead = getLookAhead();
+    float pixelsPerMs = scrollSpeed / 1000.0f;
     
-    // Draw falling notes
-    for (const auto& note : activeNotes) {
-        auto it = keyMap.find(note.midiNote);
-        if (it == keyMap.end()) continue;
+    auto drawNote = [&](const NoteInterval& note) {
+        auto it = keyMap.find(note.key);
+        if (it == keyMap.end()) return;
         
         const PianoKey& key = keys[it->second];
         
-        float timeOffset = (currentTime - note.startTime) / 1000.0f * scrollSpeed;
-        int yEnd = WATERFALL_HEIGHT - static_cast<int>(timeOffset);
+        // Notes that already started extend below the waterfall; clamp them
+        float startOffset = (static_cast<int64_t>(note.start) - songTime) * pixelsPerMs;
+        float endOffset = (static_cast<int64_t>(note.end) - songTime) * pixelsPerMs;
+        int yBottom = std::min(WATERFALL_HEIGHT, WATERFALL_HEIGHT - static_cast<int>(startOffset));
+        int yTop = std::max(0, WATERFALL_HEIGHT - static_cast<int>(endOffset));
         
-        int yStart = yEnd;
-        if (!note.active && note.endTime > 0) {
-            float duration = (note.endTime - note.startTime) / 1000.0f * scrollSpeed;
-            yStart = yEnd - static_cast<int>(duration);
-        } else {
-            yStart = 0; // Note is still active, extends to top
-        }
+        SDL_Rect noteRect;
+        noteRect.x = key.rect.x + 2;
+        noteRect.y = yTop;
+        noteRect.w = key.rect.w - 4;
+        noteRect.h = std::max(1, yBottom - yTop);
         
-        // Only draw if visible
-        if (yEnd > 0 && yStart < WATERFALL_HEIGHT) {
-            SDL_Rect noteRect;
-            noteRect.x = key.rect.x + 2;
-            noteRect.y = std::max(0, yStart);
-            noteRect.w = key.rect.w - 4;
-            noteRect.h = std::min(yEnd - noteRect.y, WATERFALL_HEIGHT - noteRect.y);
-            
-            drawFilledRect(noteRect, note.color);
-        }
-    }
+        drawFilledRect(noteRect, getNoteColor(note.velocity));
+    };
+    
+    // A window that lags behind after a stall only lacks the top rows
+    noteWindows.read().forEachInRange(songTime, songTime + lookAhead, drawNote);
+    batch.nextLayer();
 }
 
 void WaterfallPiano::renderUI() {
@@ -355,53 +969,158 @@ void WaterfallPiano::renderUI() {
     if (showHelp) {
         // Draw help overlay
         SDL_Rect helpBox = {50, 50, SCREEN_WIDTH - 100, SCREEN_HEIGHT - 100};
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
-        SDL_RenderFillRect(renderer, &helpBox);
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderDrawRect(renderer, &helpBox);
+        drawFilledRect(helpBox, {0, 0, 0, 200});
+        batch.nextLayer();
+        drawRect(helpBox, {255, 255, 255, 255});
     }
     
     // Draw playback indicator
-    if (playing && !paused) {
-        SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
+    const FrameSnapshot& frame = snapshots.read();
+    if (frame.playing && !frame.paused) {
         SDL_Rect playIndicator = {10, 10, 20, 20};
-        SDL_RenderFillRect(renderer, &playIndicator);
-    } else if (paused) {
-        SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+        drawFilledRect(playIndicator, {0, 255, 0, 255});
+    } else if (frame.paused) {
         SDL_Rect pauseBar1 = {10, 10, 7, 20};
         SDL_Rect pauseBar2 = {20, 10, 7, 20};
-        SDL_RenderFillRect(renderer, &pauseBar1);
-        SDL_RenderFillRect(renderer, &pauseBar2);
+        drawFilledRect(pauseBar1, {255, 255, 0, 255});
+        drawFilledRect(pauseBar2, {255, 255, 0, 255});
+    }
+    batch.nextLayer();
+    
+    if (!currentMidiFile.empty()) {
+        drawScrubBar();
+    }
+    
+    if (showProfiler) {
+        drawProfilerOverlay();
     }
 }
 
+void WaterfallPiano::drawScrubBar() {
+    // While dragging, the bar follows the mouse rather than the playback
+    // position, which lags by a simulation step
+    float progress = scrubbing ? scrubPosition : snapshots.read().progress;
+    int filled = static_cast<int>(progress * SCREEN_WIDTH);
+    
+    drawFilledRect({0, 0, SCREEN_WIDTH, SCRUB_BAR_HEIGHT}, {60, 60, 75, 200});
+    batch.nextLayer();
+    drawFilledRect({0, 0, filled, SCRUB_BAR_HEIGHT}, {100, 170, 255, 255});
+    batch.nextLayer();
+}
+
+float WaterfallPiano::getScrubPosition(int x) const {
+    return std::max(0.0f, std::min(1.0f, static_cast<float>(x) / SCREEN_WIDTH));
+}
+
+void WaterfallPiano::drawProfilerOverlay() {
+    // One bar per frame, newest on the right; the lines mark the 60 and
+    // 30 fps budgets
+    const int barWidth = 2;
+    const int graphHeight = 150;
+    const float pixelsPerMs = 4.0f;
+    int graphWidth = static_cast<int>(Profiler::FRAME_HISTORY) * barWidth;
+    SDL_Rect panel = {SCREEN_WIDTH - graphWidth - 10, 10, graphWidth, graphHeight};
+    drawFilledRect(panel, {0, 0, 0, 180});
+    batch.nextLayer();
+    
+    const Profiler& profiler = Profiler::shared();
+    size_t frames = profiler.getFrameCount();
+    int x = panel.x + graphWidth - static_cast<int>(frames) * barWidth;
+    for (size_t i = 0; i < frames; i++) {
+        float ms = profiler.getFrameTime(i);
+        int height = std::max(1, std::min(graphHeight, static_cast<int>(ms * pixelsPerMs)));
+        SDL_Color color = ms <= 1000.0f / 60.0f ? SDL_Color{0, 200, 0, 255}
+                        : ms <= 1000.0f / 30.0f ? SDL_Color{230, 200, 0, 255}
+                        : SDL_Color{230, 40, 40, 255};
+        drawFilledRect({x, panel.y + graphHeight - height, barWidth, height}, color);
+        x += barWidth;
+    }
+    batch.nextLayer();
+    
+    for (float budget : {1000.0f / 60.0f, 1000.0f / 30.0f}) {
+        int y = panel.y + graphHeight - static_cast<int>(budget * pixelsPerMs);
+        drawFilledRect({panel.x, y, graphWidth, 1}, {255, 255, 255, 120});
+    }
+    batch.nextLayer();
+}
+
 void WaterfallPiano::render() {
+    drawFrame();
+    
+    // Present
+    {
+        ProfileScope scope("present");
+        SDL_RenderPresent(renderer);
+    }
+    recordInputLatency();
+}
+
+void WaterfallPiano::drawFrame() {
+    frameDrawCalls = 0;
+    frameRects = 0;
+    
+    // Everything the last frame queued was flushed, so its scratch memory
+    // can be handed out again
+    frameArena.reset();
+    batch.begin(frameArena);
+    
+    // The graph shows the frames timed up to now
+    if (Profiler::shared().isEnabled()) {
+        Profiler::shared().collect();
+    }
+    
+    // Take the newest state the simulation published; without a new one
+    // the last frame is drawn again
+    snapshots.update();
+    noteWindows.update();
+    
+    const KeyStates& songKeys = snapshots.read().keys;
+    for (auto& key : keys) {
+        key.pressed = songKeys.test(key.midiNote) || liveKeys.test(key.midiNote);
+    }
+    
+    // The static layers are only redrawn when their contents were lost
+    if (layersDirty && waterfallTexture) {
+        renderLayerTextures();
+    }
+    
+    // Only the strip of notes that scrolled into view is drawn
+    if (incrementalWaterfall && noteRingTexture) {
+        updateNoteRing();
+    }
+    
     // Clear screen
     SDL_SetRenderDrawColor(renderer, 
                           COLOR_BACKGROUND.r, COLOR_BACKGROUND.g, 
                           COLOR_BACKGROUND.b, COLOR_BACKGROUND.a);
     SDL_RenderClear(renderer);
     
-    // Render components
+    // Copy the cached layers and queue everything that moves into the
+    // batch; notes never overlap the keyboard, so the order is preserved
     renderWaterfall();
     renderKeyboard();
     renderUI();
     
-    // Present
-    SDL_RenderPresent(renderer);
+    frameRects += batch.getRectCount();
+    ProfileScope scope("flush");
+    frameDrawCalls += batch.flush(renderer);
 }
 
+// Rectangles are queued and drawn when the frame's batch is flushed
 void WaterfallPiano::drawFilledRect(SDL_Rect rect, SDL_Color color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    SDL_RenderFillRect(renderer, &rect);
+    batch.addRect(rect, color);
 }
 
 void WaterfallPiano::drawRect(SDL_Rect rect, SDL_Color color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    SDL_RenderDrawRect(renderer, &rect);
+    batch.addOutline(rect, color);
 }
 
 void WaterfallPiano::handleInput() {
+    ProfileScope scope("handleInput");
+    
+    // Live MIDI notes arrive on their own thread; pick up the key changes
+    pollMidiInput();
+    
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
@@ -415,27 +1134,59 @@ void WaterfallPiano::handleInput() {
                         running = false;
                         break;
                     case SDLK_SPACE:
-                        if (playing) pauseMidi();
-                        else playMidi();
+                        sendPlaybackCommand(PlaybackCommand::TOGGLE_PLAYBACK);
                         break;
                     case SDLK_s:
-                        stopMidi();
+                        sendPlaybackCommand(PlaybackCommand::STOP);
                         break;
                     case SDLK_h:
                         showHelp = !showHelp;
                         break;
+                    case SDLK_p:
+                        showProfiler = !showProfiler;
+                        Profiler::shared().setEnabled(showProfiler || printFrameStats ||
+                                                      !profileTracePath.empty());
+                        break;
                     case SDLK_PLUS:
                     case SDLK_EQUALS:
-                        playbackSpeed = std::min(playbackSpeed + 0.1f, 3.0f);
+                        sendPlaybackCommand(PlaybackCommand::CHANGE_SPEED, 0.1f);
                         break;
                     case SDLK_MINUS:
-                        playbackSpeed = std::max(playbackSpeed - 0.1f, 0.1f);
+                        sendPlaybackCommand(PlaybackCommand::CHANGE_SPEED, -0.1f);
+                        break;
+                    case SDLK_i:
+                        incrementalWaterfall = !incrementalWaterfall;
+                        noteRingValid = false;
+                        std::cout << "Incremental waterfall: "
+                                  << (incrementalWaterfall ? "on" : "off") << std::endl;
                         break;
                 }
                 break;
                 
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    layersDirty = true;
+                }
+                break;
+                
+            case SDL_RENDER_TARGETS_RESET:
+                // Render target contents were lost; draw the layers again
+                layersDirty = true;
+                noteRingValid = false;
+                break;
+                
+            case SDL_RENDER_DEVICE_RESET:
+                // The textures themselves were lost
+                destroyLayerTextures();
+                initializeLayerTextures();
+                break;
+                
             case SDL_MOUSEBUTTONDOWN:
-                if (event.button.y >= WATERFALL_HEIGHT) {
+                if (event.button.y < SCRUB_BAR_GRAB_HEIGHT && !currentMidiFile.empty()) {
+                    scrubbing = true;
+                    scrubMoved = true;
+                    scrubPosition = getScrubPosition(event.button.x);
+                } else if (event.button.y >= WATERFALL_HEIGHT) {
                     int note = getMidiNoteFromScreenX(event.button.x, event.button.y);
                     if (note >= 0) {
                         handleKeyPress(note);
@@ -443,8 +1194,20 @@ void WaterfallPiano::handleInput() {
                 }
                 break;
                 
+            case SDL_MOUSEMOTION:
+                if (scrubbing) {
+                    scrubMoved = true;
+                    scrubPosition = getScrubPosition(event.motion.x);
+                }
+                break;
+                
             case SDL_MOUSEBUTTONUP:
-                if (event.button.y >= WATERFALL_HEIGHT) {
+                if (scrubbing) {
+                    // Letting go lands on the position for good, with sound
+                    scrubbing = false;
+                    scrubMoved = false;
+                    sendPlaybackCommand(PlaybackCommand::SEEK, getScrubPosition(event.button.x));
+                } else if (event.button.y >= WATERFALL_HEIGHT) {
                     int note = getMidiNoteFromScreenX(event.button.x, event.button.y);
                     if (note >= 0) {
                         handleKeyRelease(note);
@@ -453,6 +1216,12 @@ void WaterfallPiano::handleInput() {
                 break;
         }
     }
+    
+    // A drag sends at most one position per frame
+    if (scrubbing && scrubMoved) {
+        sendPlaybackCommand(PlaybackCommand::SCRUB, scrubPosition);
+        scrubMoved = false;
+    }
 }
 
 int WaterfallPiano::getMidiNoteFromScreenX(int x, int y) {
@@ -476,27 +1245,153 @@ int WaterfallPiano::getMidiNoteFromScreenX(int x, int y) {
 }
 
 void WaterfallPiano::run() {
-    Uint32 lastTime = SDL_GetTicks();
+    // Playback timing runs on its own thread; a frame that waits for vsync
+    // or stalls no longer delays the notes
+    Profiler::shared().setThreadName("main");
+    startSimulation();
     
     while (running) {
-        Uint32 currentTicks = SDL_GetTicks();
-        float deltaTime = (currentTicks - lastTime) / 1000.0f;
-        lastTime = currentTicks;
-        
+        ProfileScope scope("frame");
         handleInput();
-        updateWaterfall(deltaTime);
         render();
         
         SDL_Delay(1); // Small delay to prevent CPU hogging
     }
+    
+    stopSimulation();
+}
+
+FrameBenchmark WaterfallPiano::runBenchmark(int frameCount, const AllocationProbe* allocations) {
+    FrameBenchmark result = {};
+    clockTime = 0;
+    playMidi();
+    if (!playing) return result;
+    
+    running = true;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 totalCounter = 0;
+    Uint64 maxCounter = 0;
+    Uint64 updateCounter = 0;
+    Uint64 totalDrawCalls = 0;
+    Uint64 totalRects = 0;
+    int maxDrawCalls = 0;
+    int frames = 0;
+    
+    // Buffers grow to their working size during the first frames; after
+    // that, playing and drawing must not touch the heap
+    int warmUpFrames = std::min(60, frameCount / 4);
+    
+    while (running && frames < frameCount) {
+        if (frames == warmUpFrames && allocations) {
+            allocations->start();
+        }
+        
+        ProfileScope scope("frame");
+        handleInput();
+        
+        // Playback is stepped inline on a fixed 60 Hz clock, so every run
+        // draws the same frames
+        clockTime = static_cast<int64_t>(frames) * 1000000 / 60;
+        Uint64 updateBegin = SDL_GetPerformanceCounter();
+        applyPlaybackCommands();
+        if (playing && !paused) {
+            updatePlayback();
+        }
+        publishSnapshots();
+        updateCounter += SDL_GetPerformanceCounter() - updateBegin;
+        
+        // Time only the work of building and submitting the frame;
+        // presenting may block on vsync
+        Uint64 begin = SDL_GetPerformanceCounter();
+        drawFrame();
+        Uint64 frameCounter = SDL_GetPerformanceCounter() - begin;
+        totalCounter += frameCounter;
+        maxCounter = std::max(maxCounter, frameCounter);
+        SDL_RenderPresent(renderer);
+        
+        totalDrawCalls += frameDrawCalls;
+        totalRects += frameRects;
+        maxDrawCalls = std::max(maxDrawCalls, frameDrawCalls);
+        frames++;
+    }
+    if (allocations) {
+        allocations->stop();
+    }
+    
+    if (frames == 0) return result;
+    
+    result.frames = frames;
+    result.averageFrameMs = (totalCounter * 1000.0 / frequency) / frames;
+    result.maxFrameMs = maxCounter * 1000.0 / frequency;
+    result.averageUpdateMs = (updateCounter * 1000.0 / frequency) / frames;
+    result.drawCallsPerFrame = static_cast<double>(totalDrawCalls) / frames;
+    result.maxDrawCalls = maxDrawCalls;
+    result.rectsPerFrame = static_cast<double>(totalRects) / frames;
+    if (allocations && frames > warmUpFrames) {
+        result.steadyAllocations = allocations->getAllocations();
+    }
+    
+    std::cout << "Benchmark: " << frames << " frames" << std::endl;
+    std::cout << "  Average frame time: " << result.averageFrameMs << " ms"
+              << " (max " << result.maxFrameMs << " ms)" << std::endl;
+    std::cout << "  Average update time: " << result.averageUpdateMs << " ms" << std::endl;
+    std::cout << "  Draw calls per frame: " << result.drawCallsPerFrame
+              << " (max " << maxDrawCalls << ")" << std::endl;
+    std::cout << "  Rectangles per frame: " << result.rectsPerFrame << std::endl;
+    if (allocations) {
+        std::cout << "  Heap allocations after warm-up: " << result.steadyAllocations << std::endl;
+    }
+    if (result.steadyAllocations > 0) {
+        std::cerr << "Warning: steady-state playback allocated "
+                  << allocations->getBytes() << " bytes" << std::endl;
+    }
+    return result;
+}
+
+void WaterfallPiano::enableProfiling(bool overlay, const std::string& tracePath, bool frameStats) {
+    showProfiler = overlay;
+    profileTracePath = tracePath;
+    printFrameStats = frameStats;
+    
+    Profiler& profiler = Profiler::shared();
+    profiler.setTracing(!tracePath.empty());
+    profiler.setEnabled(overlay || frameStats || !tracePath.empty());
 }
 
 void WaterfallPiano::cleanup() {
-    if (waterfallTexture) {
-        SDL_DestroyTexture(waterfallTexture);
-        waterfallTexture = nullptr;
+    stopSimulation();
+    midiInput.close();
+    
+    // Everything timed so far goes into the trace and the statistics
+    Profiler& profiler = Profiler::shared();
+    if (profiler.isEnabled()) {
+        profiler.collect();
+        if (!profileTracePath.empty()) {
+            profiler.writeTrace(profileTracePath);
+            profileTracePath.clear();
+        }
+        if (printFrameStats) {
+            profiler.printStats(std::cout);
+            printFrameStats = false;
+        }
+        profiler.setEnabled(false);
     }
     
+    if (inputLatencyCount > 0) {
+        std::cout << "MIDI input to key highlight: " << inputLatencyCount << " events, average "
+                  << inputLatencyTotalNs / 1e6 / inputLatencyCount << " ms, max "
+                  << inputLatencyMaxNs / 1e6 << " ms" << std::endl;
+        inputLatencyCount = 0;
+    }
+    
+    // Stop the audio callback before anything it uses goes away
+    if (audioDevice) {
+        SDL_CloseAudioDevice(audioDevice);
+        audioDevice = 0;
+    }
+    
+    destroyLayerTextures();
+    
     if (renderer) {
         SDL_DestroyRenderer(renderer);
         renderer = nullptr;
@@ -6,50 +6,60 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <atomic>
+#include <thread>
+#include "EventScheduler.h"
+#include "NoteTimeline.h"
+#include "SeekIndex.h"
+#include "StreamingTimeline.h"
+#include "Arena.h"
+#include "RenderBatch.h"
+#include "PianoLayout.h"
+#include "Synthesizer.h"
+#include "AudioEventQueue.h"
+#include "MidiInput.h"
+#include "TripleBuffer.h"
+#include "FrameSnapshot.h"
+#include "PlaybackClock.h"
+#include "Profiler.h"
 
-// Piano constants
-const int TOTAL_KEYS = 88;
-const int FIRST_MIDI_NOTE = 21;  // A0
-const int LAST_MIDI_NOTE = 108;   // C8
-const int WHITE_KEYS = 52;
-const int BLACK_KEYS = 36;
+// MIDI files at least this large are streamed instead of parsed up front
+const size_t STREAMING_MIN_FILE_SIZE = 64 * 1024 * 1024;
 
-// Display constants
-const int SCREEN_WIDTH = 1600;
-const int SCREEN_HEIGHT = 900;
-const int KEYBOARD_HEIGHT = 150;
-const int WATERFALL_HEIGHT = SCREEN_HEIGHT - KEYBOARD_HEIGHT;
-
-// Key dimensions
-const int WHITE_KEY_WIDTH = SCREEN_WIDTH / WHITE_KEYS;
-const int WHITE_KEY_HEIGHT = KEYBOARD_HEIGHT;
-const int BLACK_KEY_WIDTH = WHITE_KEY_WIDTH * 0.6;
-const int BLACK_KEY_HEIGHT = KEYBOARD_HEIGHT * 0.6;
-
-// Colors
-const SDL_Color COLOR_WHITE_KEY = {255, 255, 255, 255};
-const SDL_Color COLOR_BLACK_KEY = {0, 0, 0, 255};
-const SDL_Color COLOR_WHITE_PRESSED = {200, 230, 255, 255};
-const SDL_Color COLOR_BLACK_PRESSED = {100, 100, 150, 255};
-const SDL_Color COLOR_BACKGROUND = {20, 20, 30, 255};
+// Cost of the frames drawn by runBenchmark()
+struct FrameBenchmark {
+    int frames;
+    double averageFrameMs;      // Building and submitting a frame
+    double maxFrameMs;
+    double averageUpdateMs;     // Playback step and snapshot publishing
+    double drawCallsPerFrame;
+    int maxDrawCalls;
+    double rectsPerFrame;
+    uint64_t steadyAllocations; // Heap allocations once warmed up; should stay 0
+};
 
-// Note structure for waterfall visualization
-struct Note {
-    int midiNote;
-    Uint32 startTime;
-    Uint32 endTime;
-    int velocity;
-    bool active;
-    SDL_Color color;
+// Heap allocation counting for runBenchmark(). The counter replaces the
+// global allocator, so it is linked into the benchmark only and handed in
+// through these hooks; the application never counts.
+struct AllocationProbe {
+    void (*start)();
+    void (*stop)();
+    uint64_t (*getAllocations)();
+    uint64_t (*getBytes)();
 };
 
-// Piano key structure
-struct PianoKey {
-    int midiNote;
-    bool isBlack;
-    SDL_Rect rect;
-    bool pressed;
-    int whiteKeyIndex;
+// Requests from the UI thread to the thread that owns playback
+struct PlaybackCommand {
+    enum Type : uint8_t {
+        TOGGLE_PLAYBACK,    // Play, or pause/resume once playing
+        STOP,
+        SEEK,               // value: position from 0 to 1
+        SCRUB,              // Like SEEK, but notes held there are not sounded again
+        CHANGE_SPEED        // value: added to the playback speed
+    };
+    
+    Type type;
+    float value;
 };
 
 class WaterfallPiano {
@@ -61,12 +71,22 @@ public:
     void run();
     void cleanup();
     
-    // MIDI functions
+    // MIDI functions; load before run(), playback is then controlled
+    // through commands
     bool loadMidiFile(const std::string& filename);
-    void playMidi();
-    void pauseMidi();
-    void stopMidi();
-    void setMidiPosition(float position);
+    void setOverlapPolicy(NotePairing::Policy policy) { overlapPolicy = policy; }
+    void sendPlaybackCommand(PlaybackCommand::Type type, float value = 0.0f);
+    
+    // Listen for live notes on an ALSA sequencer port; source may be empty
+    bool openMidiInput(const std::string& source);
+    
+    // Play the loaded song at a fixed 60 Hz step and report per-frame cost;
+    // allocations after warm-up are counted only when a probe is given
+    FrameBenchmark runBenchmark(int frameCount, const AllocationProbe* allocations = nullptr);
+    
+    // Time the hot paths: show the frame-time graph (P toggles it), write
+    // a Chrome trace to tracePath and/or print percentiles at exit
+    void enableProfiling(bool overlay, const std::string& tracePath, bool frameStats);
     
     // Rendering functions
     void render();
@@ -76,57 +96,149 @@ public:
     
     // Input handling
     void handleInput();
-    void handleKeyPress(int midiNote);
+    void handleKeyPress(int midiNote, int velocity = 100);
     void handleKeyRelease(int midiNote);
     
     // Utility functions
     int getMidiNoteFromScreenX(int x, int y);
     SDL_Color getNoteColor(int velocity);
-    void updateWaterfall(float deltaTime);
     
 private:
     // SDL components
     SDL_Window* window;
     SDL_Renderer* renderer;
-    SDL_Texture* waterfallTexture;
+    SDL_Texture* waterfallTexture;     // Cached background and guide lines
+    SDL_Texture* keyboardTexture;      // Cached keyboard with no keys pressed
+    bool layersDirty;                  // Cached layers must be redrawn
+    
+    // Incremental waterfall: notes are kept in a ring-buffer texture that
+    // only gets the newly exposed strip drawn each frame
+    SDL_Texture* noteRingTexture;
+    bool incrementalWaterfall;
+    bool noteRingValid;
+    int64_t noteRingTop;               // Scroll pixel just above the drawn notes
+    Arena frameArena;             // Scratch memory of the current frame
+    RenderBatch batch;            // Rectangles queued for the current frame
+    int frameDrawCalls;           // Draw calls issued by the last frame
+    size_t frameRects;            // Rectangles drawn by the last frame
     
-    // Piano keys
+    // Piano keys; pressed is rebuilt each frame from the song's and the
+    // live keys
     std::vector<PianoKey> keys;
     std::map<int, int> keyMap; // MIDI note -> key index
+    KeyStates liveKeys;        // Held by the mouse or live MIDI input
+    
+    // Playback runs on the simulation thread at a fixed rate, independent
+    // of the display. It owns the scheduler, the timelines and the playback
+    // state below, takes commands from the UI thread and publishes what the
+    // next frame should show; the UI thread only draws the newest snapshot
+    std::thread simulationThread;
+    std::atomic<bool> simulationRunning;
+    SpscQueue<PlaybackCommand> playbackCommands;
+    TripleBuffer<FrameSnapshot> snapshots;
+    TripleBuffer<NoteWindow> noteWindows;
+    NoteWindow publishedWindow;  // Range of the newest window (no notes)
+    KeyStates playbackKeys;      // Held by the song (simulation thread)
+    
+    // Audio output; the synthesizer is owned by the SDL audio callback and
+    // only reached through the lock-free event queues. Playback events are
+    // stamped ahead of the audio clock so the callback plays them at their
+    // exact sample offset; live (mouse) events play at the next block.
+    Synthesizer synth;
+    SDL_AudioDeviceID audioDevice;
+    int audioSampleRate;
+    uint64_t audioLatencyFrames;        // How far ahead playback is scheduled
+    AudioEventQueue scheduledAudio;
+    AudioEventQueue liveAudio;
+    std::atomic<uint64_t> audioFrames;  // Frames rendered by the callback
+    TripleBuffer<AudioClockSample> audioClock;  // Device clock for playback
+    
+    // Live MIDI input; its thread sends notes to the callback through
+    // midiAudio and key changes to the UI thread. Latency is measured from
+    // receipt to the first presented frame showing the key
+    AudioEventQueue midiAudio;
+    MidiInput midiInput;
+    uint64_t pendingInputCount;         // Key changes not yet presented
+    uint64_t pendingInputSumNs;         // Sum of their receipt times
+    uint64_t pendingInputOldestNs;
+    uint64_t inputLatencyCount;
+    uint64_t inputLatencyTotalNs;
+    uint64_t inputLatencyMaxNs;
     
     // Waterfall notes
-    std::vector<Note> activeNotes;
-    std::vector<Note> upcomingNotes;
-    
-    // MIDI data
-    struct MidiEvent {
-        Uint32 time;
-        int note;
-        int velocity;
-        bool isNoteOn;
-    };
-    std::vector<MidiEvent> midiEvents;
+    NoteTimeline timeline;
+    std::unique_ptr<StreamingTimeline> stream; // Set when the file is streamed
     
-    // Playback state
-    bool running;
+    // MIDI data; a loaded song is dispatched straight from the timeline
+    EventScheduler scheduler;
+    SeekIndex seekIndex;       // Key state keyframes of the loaded song
+    Uint32 songDuration;
+    NotePairing::Policy overlapPolicy;  // For files loaded from now on
+    
+    // Playback state (simulation thread)
     bool playing;
     bool paused;
-    Uint32 startTime;
-    Uint32 currentTime;
-    float playbackSpeed;
+    PlaybackClock playbackClock;
+    int64_t clockTime;         // Reference time of the current step (us)
+    Uint32 songTime;
     float scrollSpeed;
     
     // UI state
+    bool running;
     bool showHelp;
+    bool showProfiler;
+    std::string profileTracePath;
+    bool printFrameStats;
     std::string currentMidiFile;
     
+    // Scrub bar along the top edge: while it is dragged, the newest
+    // position is sent once per frame
+    bool scrubbing;
+    bool scrubMoved;
+    float scrubPosition;
+    
     // Helper functions
     void initializeKeys();
-    void initializeWaterfallTexture();
-    bool isBlackKey(int midiNote);
-    int getWhiteKeyIndex(int midiNote);
+    bool initializeAudio();
+    static void audioCallback(void* userdata, Uint8* stream, int length);
+    void startSimulation();
+    void stopSimulation();
+    void runSimulation();
+    void applyPlaybackCommands();
+    void publishSnapshots();
+    void playMidi();
+    void pauseMidi();
+    void stopMidi();
+    void setMidiPosition(float position, bool resumeNotes);
+    void pollMidiInput();
+    void recordInputLatency();
+    void renderAudio(float* output, int frames);
+    void queueAudioEvent(AudioEventQueue& queue, AudioEvent::Type type,
+                         int note, int velocity, uint64_t frame);
+    void initializeLayerTextures();
+    void destroyLayerTextures();
+    void renderLayerTextures();
+    void drawWaterfallBackground();
+    void drawKeyboard(int offsetY, bool showPressed);
+    void drawPressedKeys();
+    void updateNoteRing();
+    void drawNoteRingStrip(int64_t from, int64_t to);
+    void getStripTimes(int64_t from, int64_t to, uint32_t& fromTime, uint32_t& toTime) const;
+    int64_t timeToScrollPixel(uint32_t time) const;
     void drawFilledRect(SDL_Rect rect, SDL_Color color);
     void drawRect(SDL_Rect rect, SDL_Color color);
+    void drawFrame();
+    void drawProfilerOverlay();
+    int64_t readReferenceClock();
+    void updatePlayback();
+    void dispatchEvent(const MidiEvent& event, uint64_t audioFrame);
+    static bool setKeyPressed(KeyStates& states, int midiNote, bool pressed);
+    void releaseAllKeys();
+    bool loadMidiStream(const std::string& filename);
+    void seekPlayback(Uint32 time, bool resumeNotes);
+    void drawScrubBar();
+    float getScrubPosition(int x) const;
+    Uint32 getLookAhead() const;
 };
 
 #endif // WATERFALL_PIANO_H
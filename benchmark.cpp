@@ -0,0 +1,406 @@
+#include "SyntheticMidi.h"
+#include "MidiParser.h"
+#include "NoteTimeline.h"
+#include "EventScheduler.h"
+#include "SeekIndex.h"
+#include "OfflineRenderer.h"
+#include "FrameBuffer.h"
+#include "SongCache.h"
+#include "ThreadPool.h"
+#include "WaterfallPiano.h"
+#include "AllocationCounter.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+
+struct BenchmarkOptions {
+    std::string output;
+    double scale;
+    int frames;
+    int repeat;
+    bool sdl;
+    bool keepFiles;
+    std::vector<std::string> cases;
+};
+
+// Measurements of one synthetic song
+struct CaseResult {
+    std::string name;
+    uint64_t notes;
+    size_t fileBytes;
+    
+    double parseSeconds;        // Best of the repeats
+    uint64_t parsedNotes;
+    double getAllNotesSeconds;
+    double timelineSeconds;
+    
+    int schedulerFrames;
+    double schedulerAverageUs;
+    double schedulerP99Us;
+    double schedulerMaxUs;
+    double eventsPerFrame;
+    uint64_t schedulerAllocations;
+    
+    double seekIndexSeconds;
+    size_t keyframes;
+    int seeks;
+    double seekAverageUs;
+    double seekMaxUs;
+    
+    int softwareFrames;
+    double softwareAverageMs;
+    double softwareMaxMs;
+    uint64_t softwareAllocations;   // After the first frame
+    
+    bool sdlRan;
+    FrameBenchmark sdl;
+};
+
+// The counter is linked into this program only
+static const AllocationProbe ALLOCATION_COUNTER = {
+    AllocationCounter::start,
+    AllocationCounter::stop,
+    AllocationCounter::getAllocations,
+    AllocationCounter::getBytes
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void printUsage(const char* programName) {
+    std::cout << "Usage: " << programName << " [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --output <file>   Results as JSON (default benchmark-results.json)" << std::endl;
+    std::cout << "  --scale <factor>  Multiply every song's note count (default 1)" << std::endl;
+    std::cout << "  --frames <n>      Frames drawn by the render benchmarks (default 600)" << std::endl;
+    std::cout << "  --repeat <n>      Parse each song n times and keep the best (default 3)" << std::endl;
+    std::cout << "  --case <name>     Run only this song (may be repeated):" << std::endl;
+    std::cout << "                   ";
+    for (int kind = 0; kind < SyntheticMidi::KIND_COUNT; kind++) {
+        std::cout << " " << SyntheticMidi::getName(static_cast<SyntheticMidi::Kind>(kind));
+    }
+    std::cout << std::endl;
+    std::cout << "  --no-sdl          Skip the SDL render benchmark" << std::endl;
+    std::cout << "  --keep-files      Keep the generated .mid files" << std::endl;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return static_cast<bool>(file);
+}
+
+static void measureScheduler(const NoteTimeline& timeline, CaseResult& result) {
+    EventScheduler scheduler;
+    scheduler.reset(&timeline);
+    
+    // Dispatch like playback does, one call per 60 Hz frame
+    std::bitset<128> keys;
+    std::vector<double> frameUs;
+    frameUs.reserve(static_cast<size_t>(timeline.getDuration()) * 60 / 1000 + 2);
+    uint64_t dispatched = 0;
+    AllocationCounter::start();
+    for (int frame = 0; !scheduler.isFinished(); frame++) {
+        uint32_t now = static_cast<uint32_t>(frame * 1000.0 / 60.0);
+        auto begin = std::chrono::steady_clock::now();
+        dispatched += scheduler.advance(now, [&](const MidiEvent& event) {
+            keys.set(event.note & 127, event.isNoteOn);
+        });
+        frameUs.push_back(secondsSince(begin) * 1e6);
+    }
+    AllocationCounter::stop();
+    result.schedulerAllocations = AllocationCounter::getAllocations();
+    
+    result.schedulerFrames = static_cast<int>(frameUs.size());
+    if (frameUs.empty()) return;
+    
+    double total = 0.0;
+    for (double us : frameUs) total += us;
+    result.schedulerAverageUs = total / frameUs.size();
+    result.eventsPerFrame = static_cast<double>(dispatched) / frameUs.size();
+    
+    std::sort(frameUs.begin(), frameUs.end());
+    result.schedulerP99Us = frameUs[std::min(frameUs.size() - 1, frameUs.size() * 99 / 100)];
+    result.schedulerMaxUs = frameUs.back();
+}
+
+static void measureSeeks(const NoteTimeline& timeline, CaseResult& result) {
+    auto begin = std::chrono::steady_clock::now();
+    SeekIndex index;
+    index.build(timeline);
+    result.seekIndexSeconds = secondsSince(begin);
+    result.keyframes = index.getKeyframeCount();
+    
+    // Jump around the song the way a dragged scrub bar does, in a fixed
+    // pseudo-random order
+    EventScheduler scheduler;
+    scheduler.reset(&timeline);
+    KeyVelocities keys;
+    uint64_t state = 1;
+    double total = 0.0;
+    double worst = 0.0;
+    result.seeks = 1000;
+    for (int i = 0; i < result.seeks; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t time = static_cast<uint32_t>((state >> 33) % (static_cast<uint64_t>(timeline.getDuration()) + 1));
+        
+        begin = std::chrono::steady_clock::now();
+        index.seek(scheduler, time, keys);
+        double us = secondsSince(begin) * 1e6;
+        total += us;
+        worst = std::max(worst, us);
+    }
+    result.seekAverageUs = total / result.seeks;
+    result.seekMaxUs = worst;
+}
+
+static void measureSoftwareRender(const NoteTimeline& timeline, int frames, CaseResult& result) {
+    OfflineRenderer offline;
+    FrameBuffer image(SCREEN_WIDTH, SCREEN_HEIGHT);
+    
+    double total = 0.0;
+    double worst = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        if (frame == 1) {
+            AllocationCounter::start();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        offline.renderFrame(timeline, static_cast<uint32_t>(frame * 1000.0 / 60.0), image);
+        double ms = secondsSince(begin) * 1000.0;
+        total += ms;
+        worst = std::max(worst, ms);
+    }
+    AllocationCounter::stop();
+    result.softwareAllocations = frames > 1 ? AllocationCounter::getAllocations() : 0;
+    
+    result.softwareFrames = frames;
+    result.softwareAverageMs = frames > 0 ? total / frames : 0.0;
+    result.softwareMaxMs = worst;
+}
+
+static bool runCase(SyntheticMidi::Kind kind, const BenchmarkOptions& options, CaseResult& result) {
+    result = CaseResult();
+    result.name = SyntheticMidi::getName(kind);
+    result.notes = std::max<uint64_t>(1, static_cast<uint64_t>(
+        SyntheticMidi::getDefaultNoteCount(kind) * options.scale));
+    
+    std::cout << "\n== " << result.name << " (" << result.notes << " notes) ==" << std::endl;
+    
+    std::string path = (std::filesystem::temp_directory_path() /
+                        ("waterfall-bench-" + result.name + ".mid")).string();
+    {
+        std::vector<uint8_t> bytes = SyntheticMidi::generate(kind, result.notes);
+        result.fileBytes = bytes.size();
+        if (!writeFile(path, bytes)) {
+            std::cerr << "Could not write " << path << std::endl;
+            return false;
+        }
+    }
+    
+    NoteTimeline timeline;
+    {
+        // Parse: best of the repeats, the file stays in the page cache
+        std::unique_ptr<MidiParser> parser;
+        result.parseSeconds = 0.0;
+        for (int run = 0; run < options.repeat; run++) {
+            parser.reset(new MidiParser());
+            auto begin = std::chrono::steady_clock::now();
+            if (!parser->loadFile(path)) {
+                std::cerr << "Could not parse " << path << std::endl;
+                return false;
+            }
+            double seconds = secondsSince(begin);
+            if (run == 0 || seconds < result.parseSeconds) result.parseSeconds = seconds;
+        }
+        
+        result.parsedNotes = 0;
+        for (const auto& track : parser->getTracks()) {
+            result.parsedNotes += track.notes.size();
+        }
+        
+        auto begin = std::chrono::steady_clock::now();
+        size_t allNotes = parser->getAllNotes().size();
+        result.getAllNotesSeconds = secondsSince(begin);
+        
+        begin = std::chrono::steady_clock::now();
+        timeline.build(*parser);
+        result.timelineSeconds = secondsSince(begin);
+        
+        std::cout << "  parse " << result.parseSeconds * 1000.0 << " ms ("
+                  << result.fileBytes / 1e6 / result.parseSeconds << " MB/s, "
+                  << result.parsedNotes / result.parseSeconds << " notes/s), getAllNotes "
+                  << result.getAllNotesSeconds * 1000.0 << " ms (" << allNotes << "), timeline "
+                  << result.timelineSeconds * 1000.0 << " ms" << std::endl;
+    }
+    
+    measureScheduler(timeline, result);
+    std::cout << "  scheduler " << result.schedulerFrames << " frames, "
+              << result.schedulerAverageUs << " us average, " << result.schedulerP99Us << " us p99, "
+              << result.schedulerMaxUs << " us max, " << result.schedulerAllocations
+              << " allocations" << std::endl;
+    
+    measureSeeks(timeline, result);
+    std::cout << "  seek index " << result.seekIndexSeconds * 1000.0 << " ms (" << result.keyframes
+              << " keyframes), seek " << result.seekAverageUs << " us average, "
+              << result.seekMaxUs << " us max" << std::endl;
+    
+    measureSoftwareRender(timeline, options.frames, result);
+    std::cout << "  software render " << result.softwareAverageMs << " ms average, "
+              << result.softwareMaxMs << " ms max, " << result.softwareAllocations
+              << " allocations" << std::endl;
+    timeline.clear();
+    
+    // The real renderer on SDL's dummy video driver; large files take the
+    // streaming path like they do in the application
+    if (options.sdl) {
+        WaterfallPiano piano;
+        if (piano.initialize() && piano.loadMidiFile(path)) {
+            result.sdl = piano.runBenchmark(options.frames, &ALLOCATION_COUNTER);
+            result.sdlRan = result.sdl.frames > 0;
+        }
+        piano.cleanup();
+    }
+    
+    if (!options.keepFiles) {
+        std::remove(path.c_str());
+        std::remove(SongCache::getCachePath(path).c_str());
+    }
+    return true;
+}
+
+static void writeResults(std::ostream& out, const BenchmarkOptions& options,
+                         const std::vector<CaseResult>& results) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"version\": 1,\n";
+#ifdef NDEBUG
+    out << "  \"build\": \"release\",\n";
+#else
+    out << "  \"build\": \"debug\",\n";
+#endif
+    out << "  \"threads\": " << ThreadPool::shared().getThreadCount() << ",\n";
+    out << "  \"scale\": " << options.scale << ",\n";
+    out << "  \"frames\": " << options.frames << ",\n";
+    out << "  \"repeat\": " << options.repeat << ",\n";
+    out << "  \"cases\": [";
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        const CaseResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"name\": \"" << result.name << "\",\n";
+        out << "      \"notes\": " << result.notes << ",\n";
+        out << "      \"fileBytes\": " << result.fileBytes << ",\n";
+        out << "      \"parse\": {\"seconds\": " << result.parseSeconds
+            << ", \"mbPerSecond\": " << result.fileBytes / 1e6 / result.parseSeconds
+            << ", \"notes\": " << result.parsedNotes
+            << ", \"notesPerSecond\": " << result.parsedNotes / result.parseSeconds << "},\n";
+        out << "      \"getAllNotes\": {\"seconds\": " << result.getAllNotesSeconds << "},\n";
+        out << "      \"timelineBuild\": {\"seconds\": " << result.timelineSeconds << "},\n";
+        out << "      \"scheduler\": {\"frames\": " << result.schedulerFrames
+            << ", \"averageUs\": " << result.schedulerAverageUs
+            << ", \"p99Us\": " << result.schedulerP99Us
+            << ", \"maxUs\": " << result.schedulerMaxUs
+            << ", \"eventsPerFrame\": " << result.eventsPerFrame
+            << ", \"allocations\": " << result.schedulerAllocations << "},\n";
+        out << "      \"seek\": {\"indexSeconds\": " << result.seekIndexSeconds
+            << ", \"keyframes\": " << result.keyframes
+            << ", \"seeks\": " << result.seeks
+            << ", \"averageUs\": " << result.seekAverageUs
+            << ", \"maxUs\": " << result.seekMaxUs << "},\n";
+        out << "      \"softwareRender\": {\"frames\": " << result.softwareFrames
+            << ", \"averageMs\": " << result.softwareAverageMs
+            << ", \"maxMs\": " << result.softwareMaxMs
+            << ", \"allocations\": " << result.softwareAllocations << "}";
+        if (result.sdlRan) {
+            out << ",\n      \"sdlRender\": {\"frames\": " << result.sdl.frames
+                << ", \"averageMs\": " << result.sdl.averageFrameMs
+                << ", \"maxMs\": " << result.sdl.maxFrameMs
+                << ", \"updateMs\": " << result.sdl.averageUpdateMs
+                << ", \"drawCallsPerFrame\": " << result.sdl.drawCallsPerFrame
+                << ", \"rectsPerFrame\": " << result.sdl.rectsPerFrame
+                << ", \"steadyAllocations\": " << result.sdl.steadyAllocations << "}";
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    options.output = "benchmark-results.json";
+    options.scale = 1.0;
+    options.frames = 600;
+    options.repeat = 3;
+    options.sdl = true;
+    options.keepFiles = false;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--scale" && i + 1 < argc) {
+            options.scale = std::atof(argv[++i]);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--case" && i + 1 < argc) {
+            options.cases.push_back(argv[++i]);
+        } else if (arg == "--no-sdl") {
+            options.sdl = false;
+        } else if (arg == "--keep-files") {
+            options.keepFiles = true;
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.scale <= 0.0) {
+        std::cerr << "--scale must be positive" << std::endl;
+        return 1;
+    }
+    
+    // No window or sound device is needed, unless the caller chose drivers
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+    
+    std::vector<CaseResult> results;
+    bool allocated = false;
+    for (int kind = 0; kind < SyntheticMidi::KIND_COUNT; kind++) {
+        std::string name = SyntheticMidi::getName(static_cast<SyntheticMidi::Kind>(kind));
+        if (!options.cases.empty() &&
+            std::find(options.cases.begin(), options.cases.end(), name) == options.cases.end()) {
+            continue;
+        }
+        
+        CaseResult result;
+        if (!runCase(static_cast<SyntheticMidi::Kind>(kind), options, result)) return 1;
+        results.push_back(result);
+        
+        // Playback must not allocate once it is running
+        if (result.schedulerAllocations > 0 || result.sdl.steadyAllocations > 0) {
+            std::cerr << name << ": steady-state playback allocated" << std::endl;
+            allocated = true;
+        }
+    }
+    
+    std::ofstream file(options.output);
+    writeResults(file, options, results);
+    if (!file) {
+        std::cerr << "Could not write " << options.output << std::endl;
+        return 1;
+    }
+    std::cout << "\nResults written to " << options.output << std::endl;
+    return allocated ? 1 : 0;
+}
@@ -1,15 +1,38 @@
 #include "WaterfallPiano.h"
+#include "OfflineRenderer.h"
+#include "AudioRenderer.h"
+#include "NoteTimeline.h"
+#include "SongCache.h"
+#include "Synthesizer.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
 
 void printUsage(const char* programName) {
     std::cout << "\n=== Waterfall Piano - 88 Keys ===" << std::endl;
-    std::cout << "Usage: " << programName << " [midi_file.mid]" << std::endl;
+    std::cout << "Usage: " << programName << " [midi_file.mid] [options]" << std::endl;
+    std::cout << "\nOptions:" << std::endl;
+    std::cout << "  --benchmark [frames]     Play at a fixed step and report frame cost" << std::endl;
+    std::cout << "  --render <file>          Render raw RGBA video frames without a window" << std::endl;
+    std::cout << "  --render-frames <prefix> Render numbered PPM images without a window" << std::endl;
+    std::cout << "  --fps <rate>             Frame rate for offline rendering (default 60)" << std::endl;
+    std::cout << "  --render-audio <file>    Render the song's audio to a WAV file without a window" << std::endl;
+    std::cout << "  --midi-in [port]         Play live notes from an ALSA sequencer port" << std::endl;
+    std::cout << "  --synth-benchmark [n]    Time the synthesizer mixing n voices (no file needed)" << std::endl;
+    std::cout << "  --profile                Show the frame-time graph (P toggles it)" << std::endl;
+    std::cout << "  --trace <file>           Write a Chrome trace of the timed sections at exit" << std::endl;
+    std::cout << "  --frame-stats            Print p50/p99/max of every timed section at exit" << std::endl;
+    std::cout << "  --overlap <fifo|lifo>    Which note a note-off ends when a key is struck twice (default fifo)" << std::endl;
     std::cout << "\nControls:" << std::endl;
     std::cout << "  SPACE     - Play/Pause MIDI" << std::endl;
     std::cout << "  S         - Stop playback" << std::endl;
     std::cout << "  +/-       - Increase/Decrease playback speed" << std::endl;
     std::cout << "  H         - Toggle help" << std::endl;
+    std::cout << "  I         - Toggle incremental waterfall rendering" << std::endl;
+    std::cout << "  P         - Toggle the frame-time graph" << std::endl;
     std::cout << "  ESC       - Quit" << std::endl;
     std::cout << "  Mouse     - Click keys to play" << std::endl;
     std::cout << "\nFeatures:" << std::endl;
@@ -21,12 +44,134 @@ void printUsage(const char* programName) {
     std::cout << "  - Color-coded velocity" << std::endl;
     std::cout << "\nExample:" << std::endl;
     std::cout << "  " << programName << " example.mid" << std::endl;
+    std::cout << "  " << programName << " example.mid --benchmark 600" << std::endl;
+    std::cout << "  " << programName << " example.mid --render out.rgba --fps 60" << std::endl;
+    std::cout << "  " << programName << " example.mid --render-audio out.wav" << std::endl;
+    std::cout << "  " << programName << " --synth-benchmark 1024" << std::endl;
+    std::cout << "  " << programName << " --midi-in 20:0" << std::endl;
+    std::cout << "  " << programName << " example.mid --trace trace.json --frame-stats" << std::endl;
     std::cout << std::endl;
 }
 
+// Mix a fixed chord of held voices with the scalar and the SIMD kernel
+// and report how many voices one core could keep up in real time
+void runSynthBenchmark(int voices) {
+    const int sampleRate = 48000;
+    const int blockFrames = 512;
+    const int blocks = sampleRate * 10 / blockFrames;  // About 10 s of audio
+    std::vector<float> output(blockFrames * 2);
+    
+    std::cout << "Synth benchmark: " << voices << " voices, "
+              << blocks * blockFrames / static_cast<double>(sampleRate) << " s of audio" << std::endl;
+    
+    for (int pass = 0; pass < 2; pass++) {
+        Synthesizer synth;
+        synth.setSampleRate(sampleRate, blockFrames);
+        synth.setReferenceKernel(pass == 0);
+        for (int i = 0; i < voices; i++) {
+            synth.noteOn(21 + i % 88, 64 + i % 64);
+        }
+        
+        auto begin = std::chrono::steady_clock::now();
+        for (int block = 0; block < blocks; block++) {
+            synth.render(output.data(), blockFrames, 2);
+        }
+        double elapsedMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - begin).count();
+        
+        double audioMs = blocks * blockFrames * 1000.0 / sampleRate;
+        double voiceSamplesPerMs = static_cast<double>(synth.getActiveVoiceCount()) *
+                                   blocks * blockFrames / elapsedMs;
+        std::cout << "  " << synth.getKernelName() << ": " << elapsedMs << " ms, "
+                  << voiceSamplesPerMs << " voice-samples/ms, ~"
+                  << static_cast<long>(synth.getActiveVoiceCount() * audioMs / elapsedMs)
+                  << " voices in real time" << std::endl;
+    }
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "Waterfall Piano - Starting..." << std::endl;
     
+    // --synth-benchmark [voices] needs neither a window nor a MIDI file
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--synth-benchmark") {
+            int voices = (i + 1 < argc) ? std::atoi(argv[i + 1]) : 0;
+            if (voices <= 0) voices = Synthesizer::MAX_VOICES;
+            runSynthBenchmark(std::min(voices, Synthesizer::MAX_VOICES));
+            return 0;
+        }
+    }
+    
+    // --benchmark [frames] plays the song at a fixed step and reports frame cost
+    int benchmarkFrames = 0;
+    std::string renderOutput;
+    OfflineRenderer::OutputFormat renderFormat = OfflineRenderer::RAW_RGBA;
+    int renderFps = 60;
+    std::string audioOutput;
+    bool midiIn = false;
+    std::string midiSource;
+    bool profileOverlay = false;
+    std::string tracePath;
+    bool frameStats = false;
+    NotePairing::Policy overlapPolicy = NotePairing::FIRST_IN_FIRST_OUT;
+    for (int i = 1; i < argc; i++) {
+        // These work with or without a MIDI file
+        std::string arg = argv[i];
+        if (arg == "--midi-in") {
+            midiIn = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') midiSource = argv[i + 1];
+        } else if (arg == "--profile") {
+            profileOverlay = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--frame-stats") {
+            frameStats = true;
+        } else if (arg == "--overlap" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "lifo") {
+                overlapPolicy = NotePairing::LAST_IN_FIRST_OUT;
+            } else if (policy != "fifo") {
+                std::cerr << "Unknown overlap policy: " << policy << " (use fifo or lifo)" << std::endl;
+                return 1;
+            }
+        }
+    }
+    bool hasMidiFile = argc > 1 && argv[1][0] != '-';
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--benchmark") {
+            benchmarkFrames = (i + 1 < argc) ? std::atoi(argv[i + 1]) : 0;
+            if (benchmarkFrames <= 0) benchmarkFrames = 600;
+        } else if ((arg == "--render" || arg == "--render-frames") && i + 1 < argc) {
+            renderOutput = argv[++i];
+            renderFormat = arg == "--render" ? OfflineRenderer::RAW_RGBA : OfflineRenderer::PPM_FILES;
+        } else if (arg == "--fps" && i + 1 < argc) {
+            renderFps = std::atoi(argv[++i]);
+        } else if (arg == "--render-audio" && i + 1 < argc) {
+            audioOutput = argv[++i];
+        }
+    }
+    
+    // Offline rendering needs no window or sound device, so SDL is never
+    // initialized
+    if (!renderOutput.empty() || !audioOutput.empty()) {
+        NoteTimeline timeline;
+        if (!SongCache::loadTimeline(argv[1], timeline, overlapPolicy)) {
+            return 1;
+        }
+        
+        if (!renderOutput.empty()) {
+            OfflineRenderer offline;
+            offline.setFrameRate(renderFps);
+            if (!offline.render(timeline, renderOutput, renderFormat)) return 1;
+        }
+        if (!audioOutput.empty()) {
+            AudioRenderer audio;
+            if (!audio.render(timeline, audioOutput)) return 1;
+        }
+        return 0;
+    }
+    
     WaterfallPiano piano;
     
     if (!piano.initialize()) {
@@ -36,8 +181,18 @@ int main(int argc, char* argv[]) {
     
     std::cout << "Waterfall Piano initialized successfully!" << std::endl;
     
+    if (profileOverlay || !tracePath.empty() || frameStats) {
+        piano.enableProfiling(profileOverlay, tracePath, frameStats);
+    }
+    
+    piano.setOverlapPolicy(overlapPolicy);
+    
+    if (midiIn && !piano.openMidiInput(midiSource)) {
+        std::cerr << "Warning: Live MIDI input is not available." << std::endl;
+    }
+    
     // Load MIDI file if provided
-    if (argc > 1) {
+    if (hasMidiFile) {
         std::string midiFile = argv[1];
         std::cout << "Loading MIDI file: " << midiFile << std::endl;
         
@@ -53,6 +208,12 @@ int main(int argc, char* argv[]) {
         std::cout << "You can click on keys to play them!" << std::endl;
     }
     
+    if (benchmarkFrames > 0 && hasMidiFile) {
+        piano.runBenchmark(benchmarkFrames);
+        piano.cleanup();
+        return 0;
+    }
+    
     std::cout << "\nStarting main loop..." << std::endl;
     piano.run();
     
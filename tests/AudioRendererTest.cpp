@@ -0,0 +1,159 @@
+#include "AudioRenderer.h"
+#include "NoteTimeline.h"
+#include "Synthesizer.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+
+// Checks that an offline render is bit-identical however many threads
+// render it, and that Synthesizer::advance() leaves the voices exactly
+// where render() does, which the parallel chunks rely on.
+
+static const int SAMPLE_RATE = 22050;
+static const int BLOCK_FRAMES = 512;
+static const uint32_t SONG_MS = 7500;       // Several chunks and batches
+static const int NOTE_COUNT = 3000;          // Enough to steal voices
+static const size_t MANY_THREADS = 5;
+
+static int failures = 0;
+
+static void check(bool passed, const char* what) {
+    if (!passed) {
+        std::cerr << "FAIL " << what << std::endl;
+        failures++;
+    }
+}
+
+// Dense, overlapping notes, every seventh on the same key, and a few long
+// ones held across chunk edges
+static void makeTimeline(NoteTimeline& timeline) {
+    std::mt19937 random(99);
+    std::vector<uint32_t> starts;
+    for (int i = 0; i < NOTE_COUNT; i++) {
+        starts.push_back(static_cast<uint32_t>(random() % SONG_MS));
+    }
+    std::sort(starts.begin(), starts.end());
+    
+    timeline.reserve(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        uint32_t length = i % 50 == 0 ? 2000 + static_cast<uint32_t>(random() % 3000)
+                                      : static_cast<uint32_t>(random() % 400);
+        uint8_t key = static_cast<uint8_t>(i % 7 == 0 ? 60 : 21 + random() % 88);
+        uint8_t velocity = static_cast<uint8_t>(1 + random() % 127);
+        timeline.add(starts[i], length, key, velocity, 0, 0);
+    }
+    timeline.finish();
+}
+
+static std::vector<char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void testThreadCounts() {
+    NoteTimeline timeline;
+    makeTimeline(timeline);
+    
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string onePath = (directory / "audio-renderer-test-1.wav").string();
+    std::string manyPath = (directory / "audio-renderer-test-n.wav").string();
+    
+    AudioRenderer renderer;
+    renderer.setSampleRate(SAMPLE_RATE);
+    {
+        ThreadPool one(1);
+        check(renderer.render(timeline, onePath, one), "render with one thread");
+    }
+    {
+        ThreadPool many(MANY_THREADS);
+        check(renderer.render(timeline, manyPath, many), "render with several threads");
+    }
+    
+    std::vector<char> oneBytes = readFile(onePath);
+    std::vector<char> manyBytes = readFile(manyPath);
+    uint64_t expectedFrames = (static_cast<uint64_t>(timeline.getDuration()) + 1000) * SAMPLE_RATE / 1000;
+    check(oneBytes.size() == 44 + expectedFrames * 4, "the file holds the song and its tail");
+    check(oneBytes == manyBytes, "the output does not depend on the thread count");
+    
+    // Not all silence, or the comparison proves nothing
+    bool hasSound = false;
+    for (size_t i = 44; i < oneBytes.size() && !hasSound; i++) {
+        hasSound = oneBytes[i] != 0;
+    }
+    check(hasSound, "the render is not silent");
+    
+    std::remove(onePath.c_str());
+    std::remove(manyPath.c_str());
+}
+
+// One synthesizer renders, the other only advances, through the same
+// blocks with the same notes in between; afterwards both must render the
+// same samples
+static bool advanceMatchesRender(const std::vector<int>& blocks) {
+    Synthesizer rendered;
+    Synthesizer advanced;
+    rendered.setSampleRate(SAMPLE_RATE, BLOCK_FRAMES);
+    advanced.setSampleRate(SAMPLE_RATE, BLOCK_FRAMES);
+    
+    std::mt19937 random(5);
+    int longest = *std::max_element(blocks.begin(), blocks.end());
+    std::vector<float> scratch(static_cast<size_t>(longest) * 2);
+    for (int block : blocks) {
+        for (int n = 0; n < 20; n++) {
+            int key = 21 + static_cast<int>(random() % 88);
+            if (random() % 3 == 0) {
+                rendered.noteOff(key);
+                advanced.noteOff(key);
+            } else {
+                int velocity = 1 + static_cast<int>(random() % 127);
+                rendered.noteOn(key, velocity);
+                advanced.noteOn(key, velocity);
+            }
+        }
+        rendered.render(scratch.data(), block, 2);
+        advanced.advance(block);
+        if (rendered.getActiveVoiceCount() != advanced.getActiveVoiceCount()) return false;
+    }
+    
+    const int checkFrames = BLOCK_FRAMES * 3 + 17;
+    std::vector<float> expected(static_cast<size_t>(checkFrames) * 2);
+    std::vector<float> actual(expected.size());
+    rendered.render(expected.data(), checkFrames, 2);
+    advanced.render(actual.data(), checkFrames, 2);
+    return expected == actual;
+}
+
+static void testAdvance() {
+    // Blocks shorter than, equal to and longer than the mix buffer, some
+    // ending voices' envelope stages part way through
+    const std::vector<std::vector<int>> splits = {
+        {1, 1, 1, 1, 1},
+        {7, 100, 3, 250},
+        {BLOCK_FRAMES, BLOCK_FRAMES, BLOCK_FRAMES},
+        {BLOCK_FRAMES - 1, BLOCK_FRAMES + 1, 2 * BLOCK_FRAMES + 3},
+        {SAMPLE_RATE / 2, 13, SAMPLE_RATE, 1}
+    };
+    for (const std::vector<int>& blocks : splits) {
+        check(advanceMatchesRender(blocks), "advance() leaves the voices where render() does");
+    }
+}
+
+int main() {
+    testThreadCounts();
+    testAdvance();
+    
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "AudioRenderer: all checks passed" << std::endl;
+    return 0;
+}
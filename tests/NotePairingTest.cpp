@@ -0,0 +1,155 @@
+#include "NotePairing.h"
+#include <iostream>
+#include <cstdint>
+
+// Checks which note-on every note-off is paired with, under both overlap
+// policies and across lanes, channels and keys.
+
+static int failures = 0;
+
+static void check(bool passed, const char* what) {
+    if (!passed) {
+        std::cerr << "FAIL " << what << std::endl;
+        failures++;
+    }
+}
+
+// The next note-off on a key must end the note-on with this id
+static bool endsWith(NotePairing& pairing, uint32_t lane, uint8_t channel, uint8_t key,
+                     uint64_t expected) {
+    uint64_t id = 0;
+    return pairing.noteOff(lane, channel, key, id) && id == expected;
+}
+
+static void testStackedNotes() {
+    NotePairing fifo(NotePairing::FIRST_IN_FIRST_OUT);
+    NotePairing lifo(NotePairing::LAST_IN_FIRST_OUT);
+    for (uint64_t id = 1; id <= 3; id++) {
+        fifo.noteOn(0, 0, 60, id);
+        lifo.noteOn(0, 0, 60, id);
+    }
+    check(fifo.getOpenCount() == 3 && lifo.getOpenCount() == 3, "stacked notes are all open");
+    
+    check(endsWith(fifo, 0, 0, 60, 1), "FIFO ends the oldest note first");
+    check(endsWith(fifo, 0, 0, 60, 2), "FIFO ends the second note next");
+    check(endsWith(lifo, 0, 0, 60, 3), "LIFO ends the newest note first");
+    check(endsWith(lifo, 0, 0, 60, 2), "LIFO ends the second note next");
+    
+    // A note struck while one is still sounding queues behind it (FIFO)
+    // or in front of it (LIFO)
+    fifo.noteOn(0, 0, 60, 4);
+    lifo.noteOn(0, 0, 60, 4);
+    check(endsWith(fifo, 0, 0, 60, 3), "FIFO ends the remaining old note before a new one");
+    check(endsWith(fifo, 0, 0, 60, 4), "FIFO then ends the new note");
+    check(endsWith(lifo, 0, 0, 60, 4), "LIFO ends the new note before the remaining old one");
+    check(endsWith(lifo, 0, 0, 60, 1), "LIFO then ends the oldest note");
+    check(fifo.getOpenCount() == 0 && lifo.getOpenCount() == 0, "stacked notes are all ended");
+}
+
+static void testSeparation() {
+    NotePairing pairing;
+    pairing.noteOn(0, 0, 60, 1);
+    pairing.noteOn(0, 1, 60, 2);
+    pairing.noteOn(1, 0, 60, 3);
+    pairing.noteOn(1, 1, 60, 4);
+    pairing.noteOn(0, 0, 61, 5);
+    
+    // Released in an order unlike the note-ons, so a mix-up shows
+    check(endsWith(pairing, 1, 1, 60, 4), "lane 1, channel 1 has its own note");
+    check(endsWith(pairing, 0, 0, 61, 5), "a neighbouring key has its own note");
+    check(endsWith(pairing, 0, 1, 60, 2), "lane 0, channel 1 has its own note");
+    check(endsWith(pairing, 1, 0, 60, 3), "lane 1, channel 0 has its own note");
+    check(endsWith(pairing, 0, 0, 60, 1), "lane 0, channel 0 has its own note");
+    
+    // Lanes far apart allocate their slots independently
+    pairing.noteOn(1000, 15, 127, 6);
+    pairing.noteOn(3, 15, 127, 7);
+    check(endsWith(pairing, 1000, 15, 127, 6), "a distant lane has its own note");
+    check(endsWith(pairing, 3, 15, 127, 7), "a lane below it is unaffected");
+    check(pairing.getOpenCount() == 0, "separated notes are all ended");
+}
+
+static void testUnmatchedNoteOff() {
+    NotePairing pairing;
+    uint64_t id = 42;
+    check(!pairing.noteOff(0, 0, 60, id), "nothing sounds in a new pairing");
+    check(!pairing.noteOff(500, 3, 60, id), "nothing sounds in a lane never used");
+    
+    pairing.noteOn(0, 0, 60, 1);
+    check(!pairing.noteOff(0, 0, 61, id), "a silent key in a used channel is not sounding");
+    check(!pairing.noteOff(0, 1, 60, id), "a used key in another channel is not sounding");
+    check(!pairing.noteOff(1, 0, 60, id), "a used key in another lane is not sounding");
+    check(id == 42, "an unmatched note-off leaves the id alone");
+    check(pairing.getOpenCount() == 1, "an unmatched note-off ends nothing");
+    
+    check(endsWith(pairing, 0, 0, 60, 1), "the sounding note still ends");
+    check(!pairing.noteOff(0, 0, 60, id), "a key released twice is no longer sounding");
+    check(pairing.getOpenCount() == 0, "the released note is no longer open");
+    
+    pairing.noteOn(0, 0, 60, 2);
+    pairing.clear();
+    check(!pairing.noteOff(0, 0, 60, id), "clear() forgets sounding notes");
+}
+
+static void testManyOpenNotes() {
+    // Every key of every channel in several lanes, and a deep stack on one
+    // key: far more than one 128-slot block, and more nodes than slots
+    NotePairing pairing;
+    const uint32_t lanes = 3;
+    const uint64_t stackDepth = 300;
+    uint64_t expectedOpen = 0;
+    
+    for (int round = 0; round < 2; round++) {
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            for (int channel = 0; channel < 16; channel++) {
+                for (int key = 0; key < 128; key++) {
+                    uint64_t id = (static_cast<uint64_t>(lane) << 16) | (channel << 8) | key;
+                    pairing.noteOn(lane, static_cast<uint8_t>(channel), static_cast<uint8_t>(key), id);
+                    expectedOpen++;
+                }
+            }
+        }
+        for (uint64_t i = 0; i < stackDepth; i++) {
+            pairing.noteOn(7, 9, 64, 1000000 + i);
+            expectedOpen++;
+        }
+        check(pairing.getOpenCount() == expectedOpen, "every note is open at once");
+        
+        // Released back to front, so freed nodes are reused out of order
+        // in the second round
+        bool allMatched = true;
+        for (int key = 127; key >= 0; key--) {
+            for (int channel = 15; channel >= 0; channel--) {
+                for (uint32_t lane = lanes; lane-- > 0;) {
+                    uint64_t id = (static_cast<uint64_t>(lane) << 16) | (channel << 8) | key;
+                    allMatched = allMatched &&
+                        endsWith(pairing, lane, static_cast<uint8_t>(channel), static_cast<uint8_t>(key), id);
+                    expectedOpen--;
+                }
+            }
+        }
+        check(allMatched, "every key of every lane and channel ends its own note");
+        
+        bool stackMatched = true;
+        for (uint64_t i = 0; i < stackDepth; i++) {
+            stackMatched = stackMatched && endsWith(pairing, 7, 9, 64, 1000000 + i);
+            expectedOpen--;
+        }
+        check(stackMatched, "a deep stack on one key ends in order");
+        check(pairing.getOpenCount() == 0, "every note is ended");
+    }
+}
+
+int main() {
+    testStackedNotes();
+    testSeparation();
+    testUnmatchedNoteOff();
+    testManyOpenNotes();
+    
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "NotePairing: all checks passed" << std::endl;
+    return 0;
+}
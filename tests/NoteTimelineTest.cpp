@@ -0,0 +1,130 @@
+#include "NoteTimeline.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cstdint>
+
+// Checks that range queries return exactly the overlapping notes, and that
+// one note held through the whole song does not make every query look at
+// every long note before it.
+
+static const uint32_t SONG_MS = 600000;
+static const int LONG_NOTE_COUNT = 100000;
+static const uint32_t LONG_NOTE_SPACING_MS = 6;
+static const uint32_t LONG_NOTE_LENGTH_MS = 5000;
+static const int SHORT_NOTE_COUNT = 20000;
+static const int QUERY_COUNT = 2000;
+static const uint32_t MAX_WINDOW_MS = 3000;
+
+// A query may look at each note it reports twice (once by start time, once
+// as a long note) plus a few per interval tree level
+static const size_t SCAN_SLACK = 200;
+
+static int failures = 0;
+
+static void check(bool passed, const char* what) {
+    if (!passed) {
+        std::cerr << "FAIL " << what << std::endl;
+        failures++;
+    }
+}
+
+struct Note {
+    uint32_t start;
+    uint32_t length;
+    uint8_t key;
+    bool operator<(const Note& other) const {
+        if (start != other.start) return start < other.start;
+        if (key != other.key) return key < other.key;
+        return length < other.length;
+    }
+    bool operator==(const Note& other) const {
+        return start == other.start && length == other.length && key == other.key;
+    }
+};
+
+int main() {
+    // One note held through the whole song, a dense run of long notes and
+    // short notes scattered over the same time
+    std::mt19937 random(42);
+    std::vector<Note> notes;
+    notes.push_back({0, SONG_MS, 21});
+    for (int i = 0; i < LONG_NOTE_COUNT; i++) {
+        notes.push_back({static_cast<uint32_t>(i) * LONG_NOTE_SPACING_MS, LONG_NOTE_LENGTH_MS,
+                         static_cast<uint8_t>(30 + i % 60)});
+    }
+    for (int i = 0; i < SHORT_NOTE_COUNT; i++) {
+        notes.push_back({static_cast<uint32_t>(random() % SONG_MS), static_cast<uint32_t>(random() % 2000),
+                         static_cast<uint8_t>(random() % 128)});
+    }
+    // Long notes of every length, some starting at the same time
+    for (int i = 0; i < 500; i++) {
+        uint32_t start = static_cast<uint32_t>(random() % SONG_MS) / 1000 * 1000;
+        notes.push_back({start, NoteTimeline::LONG_NOTE_MS + 1 + static_cast<uint32_t>(random() % 100000), 100});
+    }
+    std::stable_sort(notes.begin(), notes.end(),
+                     [](const Note& a, const Note& b) { return a.start < b.start; });
+    
+    NoteTimeline timeline;
+    timeline.reserve(notes.size());
+    for (const Note& note : notes) {
+        timeline.add(note.start, note.length, note.key, 100, 0, 0);
+    }
+    timeline.finish();
+    
+    bool allMatch = true;
+    bool allBounded = true;
+    size_t worstScanned = 0;
+    size_t worstVisited = 0;
+    for (int q = 0; q < QUERY_COUNT; q++) {
+        uint32_t from = static_cast<uint32_t>(random() % (SONG_MS + 10000));
+        uint32_t to = from + (q % 4 == 0 ? 0 : static_cast<uint32_t>(random() % MAX_WINDOW_MS));
+        
+        std::vector<Note> expected;
+        for (const Note& note : notes) {
+            if (note.start <= to && note.start + note.length >= from) {
+                expected.push_back(note);
+            }
+        }
+        std::vector<Note> actual;
+        size_t scanned = timeline.forEachInRange(from, to, [&](const NoteInterval& note) {
+            actual.push_back({note.start, note.end - note.start, note.key});
+        });
+        std::sort(expected.begin(), expected.end());
+        std::sort(actual.begin(), actual.end());
+        allMatch = allMatch && expected == actual;
+        
+        if (scanned > 2 * actual.size() + SCAN_SLACK) {
+            allBounded = false;
+        }
+        if (scanned > worstScanned) {
+            worstScanned = scanned;
+            worstVisited = actual.size();
+        }
+    }
+    check(allMatch, "queries return exactly the overlapping notes");
+    check(allBounded, "queries look at no more notes than they report, plus a bound");
+    
+    // An empty timeline, and one with no long notes, answer queries too
+    NoteTimeline empty;
+    empty.finish();
+    size_t visited = 0;
+    empty.forEachInRange(0, SONG_MS, [&](const NoteInterval&) { visited++; });
+    check(visited == 0, "an empty timeline has no notes");
+    
+    NoteTimeline shortOnly;
+    shortOnly.add(100, 50, 60, 100, 0, 0);
+    shortOnly.add(200, 50, 61, 100, 0, 0);
+    shortOnly.finish();
+    shortOnly.forEachInRange(120, 210, [&](const NoteInterval&) { visited++; });
+    check(visited == 2, "short notes alone are found");
+    
+    std::cout << "NoteTimeline: worst query looked at " << worstScanned << " notes to report "
+              << worstVisited << std::endl;
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
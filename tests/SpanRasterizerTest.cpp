@@ -0,0 +1,83 @@
+#include "SpanRasterizer.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+// Checks every blending kernel this CPU supports against
+// SpanRasterizer::blendScalar() byte for byte: every alpha, widths from one
+// pixel to past two AVX2 blocks (so every ragged tail), over random pixels
+// in rows with padding that must not be touched.
+
+static const size_t MAX_WIDTH = 17;
+static const size_t HEIGHT = 3;
+static const size_t PADDING = 5;                // Pixels past the end of each row
+static const size_t STRIDE = (MAX_WIDTH + PADDING) * 4;
+
+static int failures = 0;
+
+static void fail(const char* kernel, size_t width, unsigned alpha, size_t index) {
+    std::cerr << "FAIL " << kernel << ", width " << width << ", alpha " << alpha
+              << ": byte " << index << " differs from the scalar blend" << std::endl;
+    failures++;
+}
+
+static void compare(SpanRasterizer::Kernel kernel, const char* name) {
+    std::mt19937 random(7);
+    std::vector<uint8_t> original(STRIDE * HEIGHT);
+    
+    for (size_t width = 1; width <= MAX_WIDTH; width++) {
+        for (unsigned alpha = 0; alpha <= 255; alpha++) {
+            for (uint8_t& byte : original) {
+                byte = static_cast<uint8_t>(random());
+            }
+            SDL_Color color;
+            color.r = static_cast<uint8_t>(random());
+            color.g = static_cast<uint8_t>(random());
+            color.b = static_cast<uint8_t>(random());
+            color.a = static_cast<uint8_t>(alpha);
+            
+            std::vector<uint8_t> expected(original);
+            for (size_t y = 0; y < HEIGHT; y++) {
+                SpanRasterizer::blendScalar(expected.data() + y * STRIDE, width, color);
+            }
+            std::vector<uint8_t> actual(original);
+            SpanRasterizer::blendRectWith(kernel, actual.data(), STRIDE, width, HEIGHT, color);
+            
+            // The first differing byte of each case is enough
+            for (size_t i = 0; i < actual.size(); i++) {
+                if (actual[i] != expected[i]) {
+                    fail(name, width, alpha, i);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    struct KernelCase {
+        SpanRasterizer::Kernel kernel;
+        const char* name;
+    };
+    const KernelCase kernels[] = {
+        {SpanRasterizer::KERNEL_SCALAR, "scalar"},
+        {SpanRasterizer::KERNEL_SSE2, "SSE2"},
+        {SpanRasterizer::KERNEL_AVX2, "AVX2"}
+    };
+    
+    for (const KernelCase& kernel : kernels) {
+        if (!SpanRasterizer::isKernelSupported(kernel.kernel)) {
+            std::cout << kernel.name << ": not supported by this CPU, skipped" << std::endl;
+            continue;
+        }
+        compare(kernel.kernel, kernel.name);
+        std::cout << kernel.name << ": checked" << std::endl;
+    }
+    
+    if (failures > 0) {
+        std::cerr << failures << " kernel checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "StreamingTimeline.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+#include <random>
+
+// Plays a streamed file whose first note is never released and checks that
+// the note buffer stays bounded by the window, not by the file, and that
+// the window holds exactly the notes it should, also after seeking from
+// keyframes in either direction.
+
+static const uint16_t TICKS_PER_QUARTER = 480;     // At the default 120 BPM
+static const int NOTE_COUNT = 100000;
+static const uint32_t NOTE_SPACING_TICKS = 4;
+static const uint32_t NOTE_LENGTH_TICKS = 10;
+static const uint32_t LONG_NOTE_TICKS = 100000;
+static const uint32_t LOOK_AHEAD_MS = 3000;
+static const uint32_t FRAME_MS = 16;
+static const size_t MAX_BUFFERED_NOTES = 10000;
+static const int SEEK_COUNT = 200;
+
+static int failures = 0;
+
+static void check(bool passed, const char* what) {
+    if (!passed) {
+        std::cerr << "FAIL " << what << std::endl;
+        failures++;
+    }
+}
+
+struct ExpectedNote {
+    uint32_t start;
+    uint32_t end;
+    uint8_t key;
+    bool operator<(const ExpectedNote& other) const {
+        if (start != other.start) return start < other.start;
+        if (key != other.key) return key < other.key;
+        return end < other.end;
+    }
+    bool operator==(const ExpectedNote& other) const {
+        return start == other.start && end == other.end && key == other.key;
+    }
+};
+
+static uint32_t ticksToMs(uint64_t tick) {
+    return static_cast<uint32_t>(tick * 500000 / TICKS_PER_QUARTER / 1000);
+}
+
+// Track events at absolute ticks, written with running status off
+struct TrackEvent {
+    uint64_t tick;
+    uint8_t status;
+    uint8_t key;
+    uint8_t velocity;
+    bool operator<(const TrackEvent& other) const { return tick < other.tick; }
+};
+
+static void writeVariableLength(std::vector<uint8_t>& out, uint32_t value) {
+    uint8_t bytes[5];
+    int count = 0;
+    do {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while (value > 0);
+    while (count > 1) {
+        out.push_back(bytes[--count] | 0x80);
+    }
+    out.push_back(bytes[0]);
+}
+
+static void writeBigEndian(std::vector<uint8_t>& out, uint32_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+static void writeTrack(std::vector<uint8_t>& file, std::vector<TrackEvent> events) {
+    std::stable_sort(events.begin(), events.end());
+    std::vector<uint8_t> data;
+    uint64_t tick = 0;
+    for (const TrackEvent& event : events) {
+        writeVariableLength(data, static_cast<uint32_t>(event.tick - tick));
+        data.push_back(event.status);
+        data.push_back(event.key);
+        data.push_back(event.velocity);
+        tick = event.tick;
+    }
+    const uint8_t endOfTrack[] = {0x00, 0xFF, 0x2F, 0x00};
+    data.insert(data.end(), endOfTrack, endOfTrack + 4);
+    
+    file.insert(file.end(), {'M', 'T', 'r', 'k'});
+    writeBigEndian(file, static_cast<uint32_t>(data.size()), 4);
+    file.insert(file.end(), data.begin(), data.end());
+}
+
+// Track 0 holds a note that is never released and one long note; track 1
+// a steady run of short, overlapping notes
+static std::vector<uint8_t> makeFile(std::vector<ExpectedNote>& notes) {
+    std::vector<TrackEvent> held;
+    held.push_back({0, 0x90, 21, 100});
+    held.push_back({40, 0x90, 22, 100});
+    held.push_back({40 + LONG_NOTE_TICKS, 0x80, 22, 0});
+    notes.push_back({0, StreamingTimeline::OPEN_END, 21});
+    notes.push_back({ticksToMs(40), ticksToMs(40 + LONG_NOTE_TICKS), 22});
+    
+    std::vector<TrackEvent> run;
+    for (int i = 0; i < NOTE_COUNT; i++) {
+        uint64_t start = 100 + static_cast<uint64_t>(i) * NOTE_SPACING_TICKS;
+        uint8_t key = static_cast<uint8_t>(30 + i % 60);
+        run.push_back({start, 0x91, key, 80});
+        run.push_back({start + NOTE_LENGTH_TICKS, 0x81, key, 0});
+        notes.push_back({ticksToMs(start), ticksToMs(start + NOTE_LENGTH_TICKS), key});
+    }
+    
+    std::vector<uint8_t> file = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2};
+    writeBigEndian(file, TICKS_PER_QUARTER, 2);
+    writeTrack(file, held);
+    writeTrack(file, run);
+    return file;
+}
+
+// Compare the window over [from, to] with the notes decoded up to to
+static bool windowMatches(const StreamingTimeline& timeline, const std::vector<ExpectedNote>& all,
+                          uint32_t from, uint32_t to) {
+    std::vector<ExpectedNote> expected;
+    for (const ExpectedNote& note : all) {
+        uint32_t end = note.end <= to ? note.end : StreamingTimeline::OPEN_END;
+        if (note.start <= to && end >= from) {
+            expected.push_back({note.start, end, note.key});
+        }
+    }
+    std::vector<ExpectedNote> actual;
+    timeline.forEachInRange(from, to, [&](const NoteInterval& note) {
+        actual.push_back({note.start, note.end, note.key});
+    });
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    return expected == actual;
+}
+
+int main() {
+    std::vector<ExpectedNote> notes;
+    std::vector<uint8_t> bytes = makeFile(notes);
+    std::string path = (std::filesystem::temp_directory_path() / "streaming-timeline-test.mid").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+    
+    StreamingTimeline timeline;
+    if (!timeline.open(path)) {
+        std::cerr << "Could not open " << path << std::endl;
+        return 1;
+    }
+    
+    // Play like WaterfallPiano does: decode ahead, drop what was
+    // dispatched and the notes that ended
+    uint32_t duration = notes.back().end;
+    size_t maxBuffered = 0;
+    bool windowsMatch = true;
+    int frame = 0;
+    for (uint32_t time = 0; time <= duration + FRAME_MS; time += FRAME_MS, frame++) {
+        timeline.fill(time + LOOK_AHEAD_MS);
+        const std::vector<MidiEvent>& events = timeline.getEvents();
+        auto due = std::upper_bound(events.begin(), events.end(), time,
+                                    [](uint32_t t, const MidiEvent& e) { return t < e.time; });
+        timeline.discardEvents(static_cast<size_t>(due - events.begin()));
+        timeline.trimNotes(time);
+        maxBuffered = std::max(maxBuffered, timeline.getBufferedNoteCount());
+        
+        if (frame % 97 == 0) {
+            windowsMatch = windowsMatch && windowMatches(timeline, notes, time, time + LOOK_AHEAD_MS);
+        }
+    }
+    check(maxBuffered <= MAX_BUFFERED_NOTES, "buffered notes stay bounded behind a held note");
+    check(windowsMatch, "the window holds every note overlapping it during playback");
+    
+    // Seeking forward from the start and back again keeps the held notes
+    timeline.rewind();
+    uint32_t target = duration / 2;
+    timeline.skipTo(target);
+    timeline.fill(target + LOOK_AHEAD_MS);
+    check(windowMatches(timeline, notes, target, target + LOOK_AHEAD_MS), "window after seeking forward");
+    check(timeline.getBufferedNoteCount() <= MAX_BUFFERED_NOTES, "buffered notes stay bounded after seeking");
+    
+    target = 1000;
+    timeline.skipTo(target);
+    timeline.fill(target + LOOK_AHEAD_MS);
+    check(windowMatches(timeline, notes, target, target + LOOK_AHEAD_MS), "window after seeking back");
+    check(timeline.getKeyframeCount() > 1, "keyframes are recorded while decoding");
+    
+    // Scrub to random times and stream positions, both ways; each seek
+    // starts from whichever keyframe is nearest. Every other time is on a
+    // 100 ms grid, which keyframes may fall on exactly
+    std::mt19937 random(1234);
+    bool seeksMatch = true;
+    bool progressSeeksMatch = true;
+    for (int i = 0; i < SEEK_COUNT; i++) {
+        target = static_cast<uint32_t>(random() % (duration + 1));
+        if (i % 2 == 1) {
+            target -= target % 100;
+        }
+        timeline.skipTo(target);
+        timeline.fill(target + LOOK_AHEAD_MS);
+        seeksMatch = seeksMatch && windowMatches(timeline, notes, target, target + LOOK_AHEAD_MS);
+        
+        float progress = static_cast<float>(random() % 1000) / 1000.0f;
+        target = timeline.skipToProgress(progress);
+        timeline.fill(target + LOOK_AHEAD_MS);
+        progressSeeksMatch = progressSeeksMatch &&
+            windowMatches(timeline, notes, target, target + LOOK_AHEAD_MS);
+    }
+    check(seeksMatch, "window after seeking to random times");
+    check(progressSeeksMatch, "window after seeking to random stream positions");
+    
+    std::remove(path.c_str());
+    
+    std::cout << "StreamingTimeline: at most " << maxBuffered << " of " << notes.size()
+              << " notes buffered, " << timeline.getKeyframeCount() << " keyframes" << std::endl;
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}